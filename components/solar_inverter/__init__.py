@@ -1,6 +1,6 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
-from esphome.components import uart, sensor, text_sensor, binary_sensor, switch, select, number
+from esphome.components import uart, sensor, text_sensor, binary_sensor, switch, select, number, web_server_base
 from esphome.const import (
     CONF_ID,
     CONF_UART_ID,
@@ -9,6 +9,7 @@ from esphome.const import (
     CONF_STEP,
     CONF_UNIT_OF_MEASUREMENT,
     CONF_MODE,
+    ENTITY_CATEGORY_DIAGNOSTIC,
 )
 
 
@@ -28,9 +29,234 @@ SolarInverter = solar_inverter_ns.class_('SolarInverter', cg.Component, uart.UAR
 InverterSelect = solar_inverter_ns.class_("InverterSelect", select.Select)
 InverterSwitch = solar_inverter_ns.class_("InverterSwitch", switch.Switch)
 InverterNumber = solar_inverter_ns.class_("InverterNumber", number.Number)
+PollProfileSelect = solar_inverter_ns.class_("PollProfileSelect", select.Select)
+
+POLL_PROFILE_DEFAULT = "default"
+
+ADAPTIVE_POLLING_SCHEMA = cv.Schema({
+    cv.Optional('stable_polls', default=5): cv.int_range(min=1, max=255),
+    cv.Optional('max_interval', default='60s'): cv.positive_time_period_milliseconds,
+    cv.Optional('power_threshold', default=50.0): cv.positive_float,
+    cv.Optional('voltage_threshold', default=0.05): cv.positive_float,
+})
+
+QPIRI_REFRESH_SCHEMA = cv.Schema({
+    cv.Optional('safety_interval', default='10min'): cv.positive_time_period_milliseconds,
+})
+
+# Числовые сенсоры схемы (QPIGS / QBEQI), которым можно задать политику публикации
+PUBLISH_POLICY_FIELDS = [
+    'grid_voltage', 'grid_freq', 'ac_output_voltage', 'ac_output_freq',
+    'output_apparent_power', 'output_active_power', 'output_load_percent',
+    'bus_voltage', 'battery_voltage', 'battery_charging_current',
+    'battery_capacity', 'inverter_temp', 'pv_input_current', 'pv_input_voltage',
+    'battery_voltage_from_scc', 'battery_discharge_current', 'pv_charging_power',
+    'fan_on_voltage_offset', 'equalization_max_current', 'equalization_elapsed_time',
+]
+
+PUBLISH_POLICY_SCHEMA = cv.All(cv.Schema({
+    cv.Required('fields'): cv.ensure_list(cv.one_of(*PUBLISH_POLICY_FIELDS, lower=True)),
+    cv.Optional('deadband'): cv.positive_float,
+    cv.Optional('deadband_percent'): cv.percentage,
+    cv.Optional('min_interval', default='0ms'): cv.positive_time_period_milliseconds,
+    cv.Optional('heartbeat', default='0ms'): cv.positive_time_period_milliseconds,
+}), cv.has_at_most_one_key('deadband', 'deadband_percent'))
+
+# Биты QPIWS с отдельными binary_sensor (таблица QPIWS_WARNINGS в inverter_warnings.h)
+QPIWS_WARNING_BITS = {
+    'inverter_fault': 0,
+    'battery_over_temperature': 1,
+    'battery_under_voltage': 2,
+    'battery_over_voltage': 3,
+    'pv_over_voltage': 4,
+    'battery_temp_too_low': 5,
+    'battery_temp_too_high': 6,
+    'pv_low_loss': 20,
+    'pv_derating': 21,
+    'temperature_derating': 22,
+    'battery_temperature_low': 23,
+    'battery_disconnect': 24,
+    'battery_low': 30,
+    'load_short_circuit': 31,
+    'dsp_communication_fault': 32,
+}
+
+WARNINGS_SCHEMA = cv.Schema({
+    cv.Optional(key): binary_sensor.binary_sensor_schema(device_class='problem')
+    for key in QPIWS_WARNING_BITS
+})
+
+# Команды, разбор которых собирается в прошивку только при наличии
+# потребителя (USE_SOLAR_INVERTER_<CMD>); QPIGS, QPI и QID — всегда
+QFLAG_SWITCHES = [
+    'buzzer_control', 'overload_bypass', 'display_escape_to_default_page', 'overload_restart',
+    'over_temperature_restart', 'backlight_control', 'alarm_primary_source_interrupt', 'fault_code_record',
+    'power_saving', 'data_log_popup', 'grid_charge_enable', 'solar_feed_to_grid',
+]
+COMMAND_CONSUMERS = {
+    'QMOD': ['device_mode_sensor', 'device_mode_text'],
+    'QFLAG': QFLAG_SWITCHES + ['qflag_unknown_flags'],
+    'QPIWS': ['warning_status_text', 'warnings'],
+    'QBEQI': [
+        'equalization_enable', 'equalization_active', 'equalization_voltage', 'equalization_time',
+        'equalization_over_time', 'equalization_period', 'equalization_max_current', 'equalization_elapsed_time',
+    ],
+    'QPIRI': [
+        'battery_recharge_voltage', 'battery_redischarge_voltage', 'max_charging_current',
+        'max_ac_charging_current', 'ac_output_rating_frequency', 'ac_output_rating_voltage', 'qpiri_refresh',
+    ],
+}
+
+
+def used_commands(config):
+    """Команды с сущностями в конфиге или явно указанные в poll: / poll_profiles / poll_diagnostics."""
+    used = {cmd for cmd, keys in COMMAND_CONSUMERS.items() if any(key in config for key in keys)}
+    polled = [entry['command'] for entry in config.get('poll', [])]
+    for profile in config['poll_profiles']:
+        polled += [entry['command'] for entry in profile['poll']]
+    polled += [diag['command'] for diag in config['poll_diagnostics']]
+    used.update(cmd.upper() for cmd in polled if cmd.upper() in COMMAND_CONSUMERS)
+    return used
+
+
+# Потоки энергии (строки ENERGY_FLOWS в inverter_energy.h) и периоды счётчиков
+ENERGY_FLOWS = {
+    'solar': solar_inverter_ns.ENERGY_FLOW_SOLAR,
+    'inverter': solar_inverter_ns.ENERGY_FLOW_INVERTER,
+    'battery_charge': solar_inverter_ns.ENERGY_FLOW_BATTERY_CHARGE,
+    'battery_discharge': solar_inverter_ns.ENERGY_FLOW_BATTERY_DISCHARGE,
+    'grid_to_load': solar_inverter_ns.ENERGY_FLOW_GRID_TO_LOAD,
+}
+ENERGY_FLOW_ICONS = {
+    'solar': 'mdi:solar-power',
+    'inverter': 'mdi:flash',
+    'battery_charge': 'mdi:battery-charging',
+    'battery_discharge': 'mdi:battery-minus',
+    'grid_to_load': 'mdi:transmission-tower',
+}
+ENERGY_PERIODS = {
+    'today': solar_inverter_ns.ENERGY_TODAY,
+    'month': solar_inverter_ns.ENERGY_MONTH,
+    'year': solar_inverter_ns.ENERGY_YEAR,
+    'total': solar_inverter_ns.ENERGY_TOTAL,
+}
+
+
+def energy_sensor_schema(flow, period):
+    icon = {'today': ENERGY_FLOW_ICONS[flow], 'month': 'mdi:calendar-month'}.get(period, 'mdi:calendar')
+    return sensor.sensor_schema(
+        unit_of_measurement='kWh', accuracy_decimals=2, icon=icon,
+        state_class='total_increasing', device_class='energy')
+
 
+# energy: — один элемент на поток, сенсоры по периодам
+ENERGY_FLOW_SCHEMA = cv.typed_schema({
+    flow: cv.Schema({cv.Optional(period): energy_sensor_schema(flow, period) for period in ENERGY_PERIODS})
+    for flow in ENERGY_FLOWS
+}, key='flow', lower=True)
 
-CONFIG_SCHEMA = cv.Schema({
+# Прежние ключи energy_solar_* / energy_inverter_* — те же счётчики
+LEGACY_ENERGY_KEYS = {
+    f'energy_{flow}_{period}': (flow, period) for flow in ('solar', 'inverter') for period in ENERGY_PERIODS
+}
+
+
+def energy_sensors(config):
+    """(поток, период, конфиг сенсора) из energy: и прежних ключей."""
+    for entry in config['energy']:
+        for period in ENERGY_PERIODS:
+            if period in entry:
+                yield entry['flow'], period, entry[period]
+    for key, (flow, period) in LEGACY_ENERGY_KEYS.items():
+        if key in config:
+            yield flow, period, config[key]
+
+
+def validate_energy_sensors(config):
+    seen = set()
+    for flow, period, _ in energy_sensors(config):
+        if (flow, period) in seen:
+            raise cv.Invalid(f"Energy sensor '{flow}' / '{period}' is configured twice")
+        seen.add((flow, period))
+    return config
+
+
+# Сутки истории в NVS: blob 102 байта — заголовок, 4 блока по 32 байта и
+# индекс, 6 записей из 126 на странице. Одна страница раздела всегда
+# свободна под сборку мусора, а живые данные держим не выше 3/4
+# остальных, иначе каждая почасовая запись тянет стирание страницы.
+# Журнал энергии (4 × 11 записей) и прочие настройки ESPHome — в запасе.
+NVS_PAGE_SIZE = 4096
+NVS_PAGE_ENTRIES = 126
+NVS_RESERVED_ENTRIES = 96
+HISTORY_DAY_ENTRIES = 6
+
+
+def max_history_days(nvs_size):
+    pages = nvs_size // NVS_PAGE_SIZE - 1
+    return (pages * NVS_PAGE_ENTRIES * 3 // 4 - NVS_RESERVED_ENTRIES) // HISTORY_DAY_ENTRIES
+
+
+def validate_energy_history(config):
+    limit = max_history_days(config['nvs_size'])
+    if config['days'] > limit:
+        raise cv.Invalid(
+            f"{config['days']} days of energy history do not fit a {config['nvs_size']} byte NVS partition "
+            f"(at most {limit}); enlarge the nvs partition and set nvs_size to match")
+    return config
+
+
+# Почасовая история энергии во флеше, выгрузка /energy_history.csv и .bin
+# (нужен web_server; частичная отдача есть только у ESPAsyncWebServer)
+ENERGY_HISTORY_SCHEMA = cv.All(cv.Schema({
+    cv.GenerateID('web_server_base_id'): cv.use_id(web_server_base.WebServerBase),
+    cv.Optional('days', default=30): cv.int_range(min=1, max=90),
+    # размер раздела nvs в байтах (по умолчанию — стандартные 20 КБ)
+    cv.Optional('nvs_size', default=0x5000): cv.int_range(min=3 * NVS_PAGE_SIZE),
+}), cv.only_with_arduino, validate_energy_history)
+
+POLL_DIAGNOSTICS_SCHEMA = cv.Schema({
+    cv.Required('command'): cv.string_strict,
+    cv.Optional('period'): sensor.sensor_schema(
+        unit_of_measurement='ms', accuracy_decimals=0, state_class='measurement',
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC),
+    cv.Optional('jitter'): sensor.sensor_schema(
+        unit_of_measurement='ms', accuracy_decimals=0, state_class='measurement',
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC),
+    cv.Optional('missed_deadlines'): sensor.sensor_schema(
+        accuracy_decimals=0, state_class='total_increasing', entity_category=ENTITY_CATEGORY_DIAGNOSTIC),
+    cv.Optional('response_time'): sensor.sensor_schema(
+        unit_of_measurement='ms', accuracy_decimals=0, state_class='measurement',
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC),
+    cv.Optional('response_timeout'): sensor.sensor_schema(
+        unit_of_measurement='ms', accuracy_decimals=0, state_class='measurement',
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC),
+})
+
+POLL_ENTRY_SCHEMA = cv.Schema({
+    cv.Required('command'): cv.string_strict,
+    cv.Required('interval'): cv.positive_time_period_milliseconds,
+    cv.Optional('enabled', default=True): cv.boolean,
+})
+
+POLL_PROFILE_SCHEMA = cv.Schema({
+    cv.Required('name'): cv.string_strict,
+    cv.Optional('interval'): cv.positive_time_period_milliseconds,
+    cv.Optional('duration'): cv.positive_time_period_milliseconds,
+    cv.Optional('poll', default=[]): cv.ensure_list(POLL_ENTRY_SCHEMA),
+})
+
+
+def validate_poll_profiles(value):
+    names = [p['name'] for p in value]
+    if POLL_PROFILE_DEFAULT in names:
+        raise cv.Invalid(f"Profile name '{POLL_PROFILE_DEFAULT}' is reserved for the poll: table")
+    if len(names) != len(set(names)):
+        raise cv.Invalid("Poll profile names must be unique")
+    return value
+
+
+CONFIG_SCHEMA = cv.All(cv.Schema({
     cv.GenerateID(): cv.declare_id(SolarInverter),
     cv.Required(CONF_UART_ID): cv.use_id(uart.UARTComponent),
 
@@ -150,33 +376,19 @@ CONFIG_SCHEMA = cv.Schema({
 
 
     # energy sensors history
-    cv.Optional('energy_solar_today'): sensor.sensor_schema(
-        unit_of_measurement='kWh', accuracy_decimals=2, icon='mdi:solar-power',
-        state_class='total_increasing', device_class='energy'),
-    cv.Optional('energy_solar_month'): sensor.sensor_schema(
-        unit_of_measurement='kWh', accuracy_decimals=2, icon='mdi:calendar-month',
-        state_class='total_increasing', device_class='energy'),
-    cv.Optional('energy_solar_year'): sensor.sensor_schema(
-        unit_of_measurement='kWh', accuracy_decimals=2, icon='mdi:calendar',
-        state_class='total_increasing', device_class='energy'),
-    cv.Optional('energy_solar_total'): sensor.sensor_schema(
-        unit_of_measurement='kWh', accuracy_decimals=2, icon='mdi:calendar',
-        state_class='total_increasing', device_class='energy'),
-    cv.Optional('energy_inverter_today'): sensor.sensor_schema(
-        unit_of_measurement='kWh', accuracy_decimals=2, icon='mdi:flash',
-        state_class='total_increasing', device_class='energy'),
-    cv.Optional('energy_inverter_month'): sensor.sensor_schema(
-        unit_of_measurement='kWh', accuracy_decimals=2, icon='mdi:calendar-month',
-        state_class='total_increasing', device_class='energy'),
-    cv.Optional('energy_inverter_year'): sensor.sensor_schema(
-        unit_of_measurement='kWh', accuracy_decimals=2, icon='mdi:calendar',
-        state_class='total_increasing', device_class='energy'),
-    cv.Optional('energy_inverter_total'): sensor.sensor_schema(
-        unit_of_measurement='kWh', accuracy_decimals=2, icon='mdi:calendar',
-        state_class='total_increasing', device_class='energy'),
+    cv.Optional('energy', default=[]): cv.ensure_list(ENERGY_FLOW_SCHEMA),
+    **{cv.Optional(key): energy_sensor_schema(flow, period) for key, (flow, period) in LEGACY_ENERGY_KEYS.items()},
+
+    # интервал между кадрами QPIGS длиннее этого не интегрируется в энергию
+    cv.Optional('energy_max_gap', default='120s'): cv.positive_time_period_milliseconds,
+    # запись счётчиков во флеш: когда поток прирос на energy_save_delta (Вт·ч) или раз в energy_save_interval
+    cv.Optional('energy_save_delta', default=100.0): cv.positive_float,
+    cv.Optional('energy_save_interval', default='10min'): cv.positive_time_period_milliseconds,
+    cv.Optional('energy_history'): ENERGY_HISTORY_SCHEMA,
 
     #QPIWS
     cv.Optional('warning_status_text'): text_sensor.text_sensor_schema(),
+    cv.Optional('warnings'): WARNINGS_SCHEMA,
 
     cv.Optional("equalization_enable"): select.SELECT_SCHEMA.extend({cv.GenerateID(): cv.declare_id(InverterSelect),}),
     cv.Optional("equalization_active"): select.SELECT_SCHEMA.extend({cv.GenerateID(): cv.declare_id(InverterSelect),}),
@@ -235,7 +447,35 @@ CONFIG_SCHEMA = cv.Schema({
         cv.Optional(CONF_MODE, default="BOX"): cv.enum(number.NUMBER_MODES, upper=True),
     }),
 
-}).extend(cv.COMPONENT_SCHEMA)
+    # poll scheduler
+    cv.Optional('poll'): cv.ensure_list(POLL_ENTRY_SCHEMA),
+    cv.Optional('poll_profiles', default=[]): cv.All(cv.ensure_list(POLL_PROFILE_SCHEMA), validate_poll_profiles),
+    cv.Optional('poll_profile_select'): select.select_schema(
+        PollProfileSelect, entity_category=ENTITY_CATEGORY_DIAGNOSTIC, icon='mdi:timer-cog-outline'),
+    cv.Optional('pipelined', default=False): cv.boolean,
+    cv.Optional('publish_budget', default='2ms'): cv.positive_time_period_microseconds,
+    cv.Optional('publish_policies', default=[]): cv.ensure_list(PUBLISH_POLICY_SCHEMA),
+    cv.Optional('adaptive_polling'): ADAPTIVE_POLLING_SCHEMA,
+    cv.Optional('qpiri_refresh'): QPIRI_REFRESH_SCHEMA,
+
+    # link state
+    cv.Optional('link_state'): text_sensor.text_sensor_schema(
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC, icon='mdi:lan-connect'),
+    cv.Optional('link_state_duration'): sensor.sensor_schema(
+        unit_of_measurement='s', accuracy_decimals=0, state_class='measurement',
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC, icon='mdi:timer-outline'),
+
+    # QFLAG flags not described in the protocol
+    cv.Optional('qflag_unknown_flags'): text_sensor.text_sensor_schema(
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC, icon='mdi:flag-outline'),
+
+    # poll scheduler diagnostics
+    cv.Optional('poll_rate'): sensor.sensor_schema(
+        unit_of_measurement='1/s', accuracy_decimals=2, state_class='measurement',
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC),
+    cv.Optional('poll_diagnostics', default=[]): cv.ensure_list(POLL_DIAGNOSTICS_SCHEMA),
+
+}).extend(cv.COMPONENT_SCHEMA), validate_energy_sensors)
 
 
 async def to_code(config):
@@ -245,21 +485,22 @@ async def to_code(config):
     uart_var = await cg.get_variable(config[CONF_UART_ID])
     cg.add(var.set_uart_parent(uart_var))
 
-    # numeric sensors (energy history)
-    numeric_sensors = {
-        'energy_solar_today': 'set_energy_solar_today_sensor',
-        'energy_solar_month': 'set_energy_solar_month_sensor',
-        'energy_solar_year': 'set_energy_solar_year_sensor',
-        'energy_solar_total': 'set_energy_solar_total_sensor',
-        'energy_inverter_today': 'set_energy_inverter_today_sensor',
-        'energy_inverter_month': 'set_energy_inverter_month_sensor',
-        'energy_inverter_year': 'set_energy_inverter_year_sensor',
-        'energy_inverter_total': 'set_energy_inverter_total_sensor',
-    }
-    for key, setter in numeric_sensors.items():
-        if key in config:
-            sens = await sensor.new_sensor(config[key])
-            cg.add(getattr(var, setter)(sens))
+    # Неиспользуемые обработчики команд, таблицы и сущности не компилируются
+    for cmd in sorted(used_commands(config)):
+        cg.add_define(f'USE_SOLAR_INVERTER_{cmd}')
+
+    # energy counters
+    for flow, period, conf in energy_sensors(config):
+        sens = await sensor.new_sensor(conf)
+        cg.add(var.set_energy_sensor(ENERGY_FLOWS[flow], ENERGY_PERIODS[period], sens))
+    cg.add(var.set_energy_max_gap(config['energy_max_gap']))
+    cg.add(var.set_energy_save_delta(config['energy_save_delta']))
+    cg.add(var.set_energy_save_interval(config['energy_save_interval']))
+    if 'energy_history' in config:
+        conf = config['energy_history']
+        base = await cg.get_variable(conf['web_server_base_id'])
+        cg.add_define('USE_SOLAR_INVERTER_HISTORY')
+        cg.add(var.set_energy_history(conf['days'], base))
 
     # text sensors
     text_sensors = {
@@ -303,20 +544,7 @@ async def to_code(config):
 
 
     # switches (auto-assign id if missing)
-    switches = {
-        "buzzer_control": "set_buzzer_control",
-        "overload_bypass": "set_overload_bypass",
-        "display_escape_to_default_page": "set_display_escape_to_default_page",
-        "overload_restart": "set_overload_restart",
-        "over_temperature_restart": "set_over_temperature_restart",
-        "backlight_control": "set_backlight_control",
-        "alarm_primary_source_interrupt": "set_alarm_primary_source_interrupt",
-        "fault_code_record": "set_fault_code_record",
-        "power_saving": "set_power_saving",
-        "data_log_popup": "set_data_log_popup",
-        "grid_charge_enable": "set_grid_charge_enable",
-        "solar_feed_to_grid": "set_solar_feed_to_grid",
-    }
+    switches = {key: f"set_{key}" for key in QFLAG_SWITCHES}
 
     for key, setter in switches.items():
         if key in config:
@@ -356,6 +584,7 @@ async def to_code(config):
             cg.add(sel.set_options_list(opt_data['options']))
             cg.add(sel.set_command_prefix(opt_data['command_prefix']))
             cg.add(sel.set_parameters(opt_data['parameters'])) 
+            cg.add(sel.set_readback_command(opt_data['command_status']))
             cg.add(var.add_inverter_select(opt_data['request_index'], sel))
             # Автоматически вызвать set_<field>()
             setter_name = f"set_{field}"
@@ -364,7 +593,7 @@ async def to_code(config):
 
     # sensors
     sensors_qbeqi = {
-        "equalization_elapsed_time": "set_equalization_time",
+        "equalization_elapsed_time": "set_equalization_elapsed_time",
         "equalization_max_current": "set_equalization_max_current",
     }
     for key, setter in sensors_qbeqi.items():
@@ -374,17 +603,17 @@ async def to_code(config):
 
     # Number fields
     number_fields = {
-        'equalization_voltage': {       'fmt': "%2.2f", 'cmd': "PBEQV", 'min': 48.0, 'max': 61.0, 'step': 0.1, 'unit': "V"},
-        'equalization_time': {          'fmt': "%3d", 'cmd': "PBEQT", 'min': 5, 'max': 900, 'step': 5, 'unit': "min"},
-        'equalization_over_time': {     'fmt': "%3d", 'cmd': "PBEQOT", 'min': 5, 'max': 900, 'step': 5, 'unit': "min"},
-        'equalization_period': {        'fmt': "%3d", 'cmd': "PBEQP", 'min': 0, 'max': 90, 'step': 1, 'unit': "d"},
+        'equalization_voltage': {       'fmt': "%2.2f", 'cmd': "PBEQV", 'min': 48.0, 'max': 61.0, 'step': 0.1, 'unit': "V", 'status': "QBEQI"},
+        'equalization_time': {          'fmt': "%3d", 'cmd': "PBEQT", 'min': 5, 'max': 900, 'step': 5, 'unit': "min", 'status': "QBEQI"},
+        'equalization_over_time': {     'fmt': "%3d", 'cmd': "PBEQOT", 'min': 5, 'max': 900, 'step': 5, 'unit': "min", 'status': "QBEQI"},
+        'equalization_period': {        'fmt': "%3d", 'cmd': "PBEQP", 'min': 0, 'max': 90, 'step': 1, 'unit': "d", 'status': "QBEQI"},
         # QPIRI
-        'battery_recharge_voltage': {   'fmt': "%2.1f", 'cmd': "PBCV", 'min': 42, 'max': 51, 'step': 1, 'unit': "V"},
-        'battery_redischarge_voltage': {'fmt': "%2.1f", 'cmd': "PBDV", 'min': 48, 'max': 58, 'step': 1, 'unit': "V"},
-        'max_charging_current': {       'fmt': "%3d", 'cmd': "MNCHGC", 'min': 10, 'max': 120, 'step': 10, 'unit': "A"},
-        'max_ac_charging_current': {    'fmt': "%3d", 'cmd': "MUCHGC", 'min': 2, 'max': 100, 'step': 10, 'unit': "A"},
-        'ac_output_rating_frequency': { 'fmt': "%2d", 'cmd': "F", 'min': 50, 'max': 60, 'step': 10, 'unit': "Hz"},
-        'ac_output_rating_voltage': {   'fmt': "%3d", 'cmd': "V", 'min': 220, 'max': 240, 'step': 10, 'unit': "V"},
+        'battery_recharge_voltage': {   'fmt': "%2.1f", 'cmd': "PBCV", 'min': 42, 'max': 51, 'step': 1, 'unit': "V", 'status': "QPIRI"},
+        'battery_redischarge_voltage': {'fmt': "%2.1f", 'cmd': "PBDV", 'min': 48, 'max': 58, 'step': 1, 'unit': "V", 'status': "QPIRI"},
+        'max_charging_current': {       'fmt': "%3d", 'cmd': "MNCHGC", 'min': 10, 'max': 120, 'step': 10, 'unit': "A", 'status': "QPIRI"},
+        'max_ac_charging_current': {    'fmt': "%3d", 'cmd': "MUCHGC", 'min': 2, 'max': 100, 'step': 10, 'unit': "A", 'status': "QPIRI"},
+        'ac_output_rating_frequency': { 'fmt': "%2d", 'cmd': "F", 'min': 50, 'max': 60, 'step': 10, 'unit': "Hz", 'status': "QPIRI"},
+        'ac_output_rating_voltage': {   'fmt': "%3d", 'cmd': "V", 'min': 220, 'max': 240, 'step': 10, 'unit': "V", 'status': "QPIRI"},
     }
 
 
@@ -406,6 +635,7 @@ async def to_code(config):
             cg.add(num.set_parent(par))
             cg.add(num.set_command_prefix(props['cmd']))
             cg.add(num.set_format(props['fmt']))
+            cg.add(num.set_readback_command(props['status']))
             if props['unit']:
                 num.traits.set_unit_of_measurement(props['unit'])
             num.traits.set_mode(nconf[CONF_MODE])
@@ -414,4 +644,57 @@ async def to_code(config):
             if hasattr(var, setter_name):
                 cg.add(getattr(var, setter_name)(num))
 
-
+    # poll scheduler
+    for entry in config.get('poll', []):
+        cg.add(var.add_poll_command(entry['command'], entry['interval'], entry['enabled']))
+    for profile in config['poll_profiles']:
+        cg.add(var.add_poll_profile(profile['name'], profile.get('interval', 0), profile.get('duration', 0)))
+        for entry in profile['poll']:
+            cg.add(var.add_poll_profile_override(profile['name'], entry['command'], entry['interval'],
+                                                 entry['enabled']))
+    if 'poll_profile_select' in config:
+        options = [POLL_PROFILE_DEFAULT] + [profile['name'] for profile in config['poll_profiles']]
+        sel = await select.new_select(config['poll_profile_select'], options=options)
+        cg.add(sel.set_parent(var))
+        cg.add(var.set_poll_profile_select(sel))
+    if config['pipelined']:
+        cg.add(var.set_pipelined(True))
+    cg.add(var.set_publish_budget_us(config['publish_budget']))
+    for policy in config['publish_policies']:
+        for field in policy['fields']:
+            slot = cg.RawExpression(f"esphome::solar_inverter::SLOT_{field.upper()}")
+            cg.add(var.add_publish_policy(slot, policy.get('deadband', 0.0), policy.get('deadband_percent', 0.0),
+                                          policy['min_interval'], policy['heartbeat']))
+    if 'adaptive_polling' in config:
+        conf = config['adaptive_polling']
+        cg.add(var.set_adaptive_polling(conf['stable_polls'], conf['max_interval'],
+                                        conf['power_threshold'], conf['voltage_threshold']))
+    if 'qpiri_refresh' in config:
+        cg.add(var.set_qpiri_event_driven(config['qpiri_refresh']['safety_interval']))
+
+    # link state
+    if 'link_state' in config:
+        sens = await text_sensor.new_text_sensor(config['link_state'])
+        cg.add(var.set_link_state_text_sensor(sens))
+    if 'link_state_duration' in config:
+        sens = await sensor.new_sensor(config['link_state_duration'])
+        cg.add(var.set_link_state_duration_sensor(sens))
+
+    if 'qflag_unknown_flags' in config:
+        sens = await text_sensor.new_text_sensor(config['qflag_unknown_flags'])
+        cg.add(var.set_qflag_unknown_flags_sensor(sens))
+
+    # poll scheduler diagnostics
+    if 'poll_rate' in config:
+        sens = await sensor.new_sensor(config['poll_rate'])
+        cg.add(var.set_poll_rate_sensor(sens))
+    for diag in config['poll_diagnostics']:
+        diag_sensors = []
+        for key in ('period', 'jitter', 'missed_deadlines', 'response_time', 'response_timeout'):
+            diag_sensors.append(await sensor.new_sensor(diag[key]) if key in diag else cg.nullptr)
+        cg.add(var.add_poll_diagnostics(diag['command'], *diag_sensors))
+
+    # QPIWS: отдельные предупреждения
+    for key, conf in config.get('warnings', {}).items():
+        sens = await binary_sensor.new_binary_sensor(conf)
+        cg.add(var.set_warning_binary_sensor(QPIWS_WARNING_BITS[key], sens))
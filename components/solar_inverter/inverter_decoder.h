@@ -0,0 +1,270 @@
+// inverter_decoder.h
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include "esphome/core/defines.h"
+#include "inverter_frame.h"
+
+namespace esphome {
+namespace solar_inverter {
+
+// Что делать со значением поля
+enum FieldType : uint8_t {
+  FIELD_SENSOR,        // число * scale -> sensor::Sensor
+  FIELD_NUMBER,        // число * scale -> InverterNumber (с подтверждением записи)
+  FIELD_SELECT,        // код -> InverterSelect
+  FIELD_TEXT,          // строка -> text_sensor::TextSensor
+  FIELD_STATUS_BITS,   // QPIGS b7..b0
+  FIELD_FLAG_BITS,     // QPIGS b10..b8
+};
+
+// Ячейка сущности, которую заполняет поле (SolarInverter::field_entities_)
+enum EntitySlot : uint8_t {
+  SLOT_NONE,
+  // QPIGS
+  SLOT_GRID_VOLTAGE,
+  SLOT_GRID_FREQ,
+  SLOT_AC_OUTPUT_VOLTAGE,
+  SLOT_AC_OUTPUT_FREQ,
+  SLOT_OUTPUT_APPARENT_POWER,
+  SLOT_OUTPUT_ACTIVE_POWER,
+  SLOT_OUTPUT_LOAD_PERCENT,
+  SLOT_BUS_VOLTAGE,
+  SLOT_BATTERY_VOLTAGE,
+  SLOT_BATTERY_CHARGING_CURRENT,
+  SLOT_BATTERY_CAPACITY,
+  SLOT_INVERTER_TEMP,
+  SLOT_PV_INPUT_CURRENT,
+  SLOT_PV_INPUT_VOLTAGE,
+  SLOT_BATTERY_VOLTAGE_FROM_SCC,
+  SLOT_BATTERY_DISCHARGE_CURRENT,
+  SLOT_FAN_ON_VOLTAGE_OFFSET,
+  SLOT_EEPROM_VERSION,
+  SLOT_PV_CHARGING_POWER,
+  // QBEQI
+  SLOT_EQUALIZATION_ENABLE,
+  SLOT_EQUALIZATION_TIME,
+  SLOT_EQUALIZATION_PERIOD,
+  SLOT_EQUALIZATION_MAX_CURRENT,
+  SLOT_EQUALIZATION_VOLTAGE,
+  SLOT_EQUALIZATION_OVER_TIME,
+  SLOT_EQUALIZATION_ACTIVE,
+  SLOT_EQUALIZATION_ELAPSED_TIME,
+  // QPIRI
+  SLOT_GRID_RATING_VOLTAGE,
+  SLOT_GRID_RATING_CURRENT,
+  SLOT_AC_OUTPUT_RATING_VOLTAGE,
+  SLOT_AC_OUTPUT_RATING_FREQUENCY,
+  SLOT_AC_OUTPUT_RATING_CURRENT,
+  SLOT_AC_OUTPUT_APPARENT_POWER,
+  SLOT_AC_OUTPUT_ACTIVE_POWER,
+  SLOT_BATTERY_RATING_VOLTAGE,
+  SLOT_BATTERY_RECHARGE_VOLTAGE,
+  SLOT_BATTERY_UNDERVOLTAGE,
+  SLOT_BATTERY_BULK_VOLTAGE,
+  SLOT_BATTERY_FLOAT_VOLTAGE,
+  SLOT_BATTERY_TYPE,
+  SLOT_MAX_AC_CHARGING_CURRENT,
+  SLOT_MAX_CHARGING_CURRENT,
+  SLOT_INPUT_VOLTAGE_RANGE,
+  SLOT_OUTPUT_SOURCE_PRIORITY,
+  SLOT_CHARGER_SOURCE_PRIORITY,
+  SLOT_PARALLEL_MAX_NUMBER,
+  SLOT_MACHINE_TYPE,
+  SLOT_TOPOLOGY,
+  SLOT_OUTPUT_MODE,
+  SLOT_BATTERY_REDISCHARGE_VOLTAGE,
+  SLOT_PV_OK_CONDITION,
+  SLOT_PV_POWER_BALANCE,
+  SLOT_NEIZVESTNO,
+  SLOT_GRID_TIE_CURRENT,
+  SLOT_OPERATION_LOGIC,
+
+  SLOT_COUNT,
+};
+
+struct FieldDescriptor {
+  uint8_t index;     // номер поля в ответе
+  FieldType type;
+  float scale;
+  EntitySlot slot;
+};
+
+// Ответ, разбираемый и публикуемый по таблице полей
+struct ResponseDescriptor {
+  const char *command;
+  const FieldDescriptor *fields;
+  uint8_t field_count;
+  uint8_t min_fields;   // короче — кадр отбрасывается
+};
+
+// ────────────────────────────────────────────────────────────────
+// Таблицы полей. Новое поле — строка в таблице и ячейка в EntitySlot,
+// новая команда — таблица и строка в RESPONSES. Таблицы QBEQI/QPIRI
+// собираются, только если в YAML есть их сущности (USE_SOLAR_INVERTER_*).
+// ────────────────────────────────────────────────────────────────
+inline constexpr FieldDescriptor QPIGS_FIELDS[] = {
+    {0, FIELD_SENSOR, 1.0f, SLOT_GRID_VOLTAGE},               // BBB.B  V
+    {1, FIELD_SENSOR, 1.0f, SLOT_GRID_FREQ},                  // CC.C   Hz
+    {2, FIELD_SENSOR, 1.0f, SLOT_AC_OUTPUT_VOLTAGE},          // DDD.D  V
+    {3, FIELD_SENSOR, 1.0f, SLOT_AC_OUTPUT_FREQ},             // EE.E   Hz
+    {4, FIELD_SENSOR, 1.0f, SLOT_OUTPUT_APPARENT_POWER},      // FFFF   VA
+    {5, FIELD_SENSOR, 1.0f, SLOT_OUTPUT_ACTIVE_POWER},        // GGGG   W
+    {6, FIELD_SENSOR, 1.0f, SLOT_OUTPUT_LOAD_PERCENT},        // HHH    %
+    {7, FIELD_SENSOR, 1.0f, SLOT_BUS_VOLTAGE},                // III    V
+    {8, FIELD_SENSOR, 1.0f, SLOT_BATTERY_VOLTAGE},            // JJ.JJ  V
+    {9, FIELD_SENSOR, 1.0f, SLOT_BATTERY_CHARGING_CURRENT},   // KKK    A
+    {10, FIELD_SENSOR, 1.0f, SLOT_BATTERY_CAPACITY},          // OOO    %
+    {11, FIELD_SENSOR, 1.0f, SLOT_INVERTER_TEMP},             // TTTT   °C
+    {12, FIELD_SENSOR, 1.0f, SLOT_PV_INPUT_CURRENT},          // EEEE   A
+    {13, FIELD_SENSOR, 1.0f, SLOT_PV_INPUT_VOLTAGE},          // UUU.U  V
+    {14, FIELD_SENSOR, 1.0f, SLOT_BATTERY_VOLTAGE_FROM_SCC},  // WW.WW  V
+    {15, FIELD_SENSOR, 1.0f, SLOT_BATTERY_DISCHARGE_CURRENT}, // PPPPP  A
+    {16, FIELD_STATUS_BITS, 1.0f, SLOT_NONE},                 // b7..b0
+    {17, FIELD_SENSOR, 0.01f, SLOT_FAN_ON_VOLTAGE_OFFSET},    // QQ     10 mV
+    {18, FIELD_TEXT, 1.0f, SLOT_EEPROM_VERSION},              // VV
+    {19, FIELD_SENSOR, 1.0f, SLOT_PV_CHARGING_POWER},         // MMMMM  W
+    {20, FIELD_FLAG_BITS, 1.0f, SLOT_NONE},                   // b10..b8
+};
+
+#ifdef USE_SOLAR_INVERTER_QBEQI
+inline constexpr FieldDescriptor QBEQI_FIELDS[] = {
+    {0, FIELD_SELECT, 1.0f, SLOT_EQUALIZATION_ENABLE},        // B      0/1
+    {1, FIELD_NUMBER, 1.0f, SLOT_EQUALIZATION_TIME},          // CCC    мин
+    {2, FIELD_NUMBER, 1.0f, SLOT_EQUALIZATION_PERIOD},        // DDD    дни
+    {3, FIELD_SENSOR, 1.0f, SLOT_EQUALIZATION_MAX_CURRENT},   // EEE    A
+    {5, FIELD_NUMBER, 1.0f, SLOT_EQUALIZATION_VOLTAGE},       // GG.GG  V
+    {7, FIELD_NUMBER, 1.0f, SLOT_EQUALIZATION_OVER_TIME},     // III    мин
+    {8, FIELD_SELECT, 1.0f, SLOT_EQUALIZATION_ACTIVE},        // J      0/1
+    {9, FIELD_SENSOR, 1.0f, SLOT_EQUALIZATION_ELAPSED_TIME},  // KKKK   ч
+};
+
+#endif
+
+#ifdef USE_SOLAR_INVERTER_QPIRI
+inline constexpr FieldDescriptor QPIRI_FIELDS[] = {
+    {0, FIELD_SENSOR, 1.0f, SLOT_GRID_RATING_VOLTAGE},          // BBB.B  V
+    {1, FIELD_SENSOR, 1.0f, SLOT_GRID_RATING_CURRENT},          // CC.C   A
+    {2, FIELD_NUMBER, 1.0f, SLOT_AC_OUTPUT_RATING_VOLTAGE},     // DDD.D  (10) V
+    {3, FIELD_NUMBER, 1.0f, SLOT_AC_OUTPUT_RATING_FREQUENCY},   // EE.E   (09) Hz
+    {4, FIELD_NUMBER, 1.0f, SLOT_AC_OUTPUT_RATING_CURRENT},     // FF.F   A
+    {5, FIELD_NUMBER, 1.0f, SLOT_AC_OUTPUT_APPARENT_POWER},     // HHHH   VA
+    {6, FIELD_NUMBER, 1.0f, SLOT_AC_OUTPUT_ACTIVE_POWER},       // IIII   W
+    {7, FIELD_NUMBER, 1.0f, SLOT_BATTERY_RATING_VOLTAGE},       // JJ.J   V
+    {8, FIELD_NUMBER, 1.0f, SLOT_BATTERY_RECHARGE_VOLTAGE},     // KK.K   (12) V
+    {9, FIELD_NUMBER, 1.0f, SLOT_BATTERY_UNDERVOLTAGE},         // JJ.J   (29) V
+    {10, FIELD_NUMBER, 1.0f, SLOT_BATTERY_BULK_VOLTAGE},        // KK.K   (26) V
+    {11, FIELD_NUMBER, 1.0f, SLOT_BATTERY_FLOAT_VOLTAGE},       // LL.L   (27) V
+    {12, FIELD_SELECT, 1.0f, SLOT_BATTERY_TYPE},                // O      (05) 0: AGM 1: Flooded 2: User ...
+    {13, FIELD_NUMBER, 1.0f, SLOT_MAX_AC_CHARGING_CURRENT},     // PPP    (11) A
+    {14, FIELD_NUMBER, 1.0f, SLOT_MAX_CHARGING_CURRENT},        // QQ0    (02) A
+    {15, FIELD_SELECT, 1.0f, SLOT_INPUT_VOLTAGE_RANGE},         // O      (03) 0: Appliance 1: UPS
+    {16, FIELD_SELECT, 1.0f, SLOT_OUTPUT_SOURCE_PRIORITY},      // P      (01)
+    {17, FIELD_SELECT, 1.0f, SLOT_CHARGER_SOURCE_PRIORITY},     // Q      (16)
+    {18, FIELD_SENSOR, 1.0f, SLOT_PARALLEL_MAX_NUMBER},         // R
+    {19, FIELD_SELECT, 1.0f, SLOT_MACHINE_TYPE},                // SS     00: Grid tie 01: Off Grid 10: Hybrid
+    {20, FIELD_SELECT, 1.0f, SLOT_TOPOLOGY},                    // T      0: transformerless 1: transformer
+    {21, FIELD_SELECT, 1.0f, SLOT_OUTPUT_MODE},                 // U
+    {22, FIELD_NUMBER, 1.0f, SLOT_BATTERY_REDISCHARGE_VOLTAGE}, // VV.V   (13) V
+    {23, FIELD_SELECT, 1.0f, SLOT_PV_OK_CONDITION},             // W
+    {24, FIELD_SELECT, 1.0f, SLOT_PV_POWER_BALANCE},            // X
+    {25, FIELD_SENSOR, 1.0f, SLOT_NEIZVESTNO},                  // X.XX
+    {26, FIELD_NUMBER, 1.0f, SLOT_GRID_TIE_CURRENT},            // YY     (38) A
+    {27, FIELD_NUMBER, 1.0f, SLOT_OPERATION_LOGIC},             // Zz.z
+};
+#endif
+
+inline constexpr ResponseDescriptor RESPONSES[] = {
+    {"QPIGS", QPIGS_FIELDS, std::size(QPIGS_FIELDS), 21},
+#ifdef USE_SOLAR_INVERTER_QBEQI
+    {"QBEQI", QBEQI_FIELDS, std::size(QBEQI_FIELDS), 1},
+#endif
+#ifdef USE_SOLAR_INVERTER_QPIRI
+    {"QPIRI", QPIRI_FIELDS, std::size(QPIRI_FIELDS), 1},
+#endif
+};
+inline constexpr size_t RESPONSE_COUNT = std::size(RESPONSES);
+
+static_assert(std::size(QPIGS_FIELDS) <= InverterFrame::MAX_FIELDS, "QPIGS table too long");
+#ifdef USE_SOLAR_INVERTER_QBEQI
+static_assert(std::size(QBEQI_FIELDS) <= InverterFrame::MAX_FIELDS, "QBEQI table too long");
+#endif
+#ifdef USE_SOLAR_INVERTER_QPIRI
+static_assert(std::size(QPIRI_FIELDS) <= InverterFrame::MAX_FIELDS, "QPIRI table too long");
+#endif
+
+// Значение одного поля; text указывает в буфер кадра
+struct DecodedField {
+  float value;
+  std::string_view text;
+};
+
+// Разбор одного поля по описателю. Не трогает кучу и сущности —
+// можно гонять отдельно от компонента.
+inline bool decode_field(const InverterFrame &frame, const FieldDescriptor &desc, DecodedField &out) {
+  if (desc.index >= frame.field_count)
+    return false;
+  out.text = frame.field(desc.index);
+  if (desc.type != FIELD_SENSOR && desc.type != FIELD_NUMBER)
+    return true;
+  if (!frame.field_float(desc.index, out.value))
+    return false;
+  out.value *= desc.scale;
+  return true;
+}
+
+// ────────────────────────────────────────────────────────────────
+// Снимок ответа: кадр и все числовые поля, разобранные один раз при
+// приёме. Публикация, учёт энергии и лямбды читают один и тот же
+// снимок, поэтому значения в нём всегда из одного кадра.
+// ────────────────────────────────────────────────────────────────
+struct ResponseSnapshot {
+  const ResponseDescriptor *response{nullptr};
+  uint32_t sequence{0};      // растёт с каждым кадром; 0 — ответа ещё не было
+  uint32_t received_ms{0};   // millis() приёма кадра
+  InverterFrame frame;
+  float values[InverterFrame::MAX_FIELDS];   // по строкам таблицы; NAN — не число
+
+  // Поле по строке таблицы; text указывает в frame этого снимка
+  bool field(size_t row, DecodedField &out) const {
+    if (this->response == nullptr || row >= this->response->field_count)
+      return false;
+    const FieldDescriptor &desc = this->response->fields[row];
+    if (desc.index >= this->frame.field_count)
+      return false;
+    out.value = this->values[row];
+    out.text = this->frame.field(desc.index);
+    return !(desc.type == FIELD_SENSOR || desc.type == FIELD_NUMBER) || !std::isnan(out.value);
+  }
+
+  // Числовое значение поля по ячейке сущности; NAN, если его нет
+  float value(EntitySlot slot) const {
+    if (this->response == nullptr)
+      return NAN;
+    for (size_t row = 0; row < this->response->field_count; row++) {
+      if (this->response->fields[row].slot == slot)
+        return this->values[row];
+    }
+    return NAN;
+  }
+};
+
+inline void build_snapshot(const ResponseDescriptor &response, const InverterFrame &frame, uint32_t sequence,
+                           uint32_t now, ResponseSnapshot &out) {
+  out.response = &response;
+  out.sequence = sequence;
+  out.received_ms = now;
+  out.frame = frame;
+  for (size_t row = 0; row < response.field_count; row++) {
+    DecodedField field;
+    const FieldDescriptor &desc = response.fields[row];
+    bool numeric = desc.type == FIELD_SENSOR || desc.type == FIELD_NUMBER;
+    out.values[row] = numeric && decode_field(out.frame, desc, field) ? field.value : NAN;
+  }
+}
+
+}  // namespace solar_inverter
+}  // namespace esphome
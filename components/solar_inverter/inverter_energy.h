@@ -0,0 +1,272 @@
+// inverter_energy.h
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include "esphome/core/preferences.h"
+#include "esphome/components/sensor/sensor.h"
+#include "inverter_decoder.h"
+#include "inverter_frame.h"
+
+namespace esphome {
+namespace solar_inverter {
+
+enum EnergyPeriod : uint8_t {
+  ENERGY_TODAY,
+  ENERGY_MONTH,
+  ENERGY_YEAR,
+  ENERGY_TOTAL,
+  ENERGY_PERIOD_COUNT,
+};
+
+// ────────────────────────────────────────────────────────────────
+// Интеграл мощности по отметкам времени принятых кадров (трапеции).
+// Интервал длиннее max_gap (пропущенные опросы, нет связи) не
+// интегрируется — мощность за него неизвестна. Остаток меньше 1 мВт·ч
+// переносится в следующий интервал, так что ничего не теряется.
+// ────────────────────────────────────────────────────────────────
+class EnergyIntegrator {
+ public:
+  static constexpr uint32_t WMS_PER_MWH = 3600;  // Вт·мс в мВт·ч
+
+  void set_max_gap(uint32_t ms) { this->max_gap_ms_ = ms; }
+
+  // Новый замер; возвращает прирост энергии в мВт·ч
+  uint32_t add_sample(float power_w, uint32_t timestamp_ms) {
+    if (!std::isfinite(power_w) || power_w < 0)
+      power_w = 0;
+    uint32_t increment = 0;
+    uint32_t dt = timestamp_ms - this->last_ms_;
+    if (this->has_last_ && dt > 0 && dt <= this->max_gap_ms_) {
+      // (P0 + P1) / 2 · dt, Вт·мс
+      uint64_t wms = static_cast<uint64_t>(std::llround((double(this->last_power_w_) + power_w) * 0.5 * dt));
+      wms += this->remainder_wms_;
+      increment = static_cast<uint32_t>(wms / WMS_PER_MWH);
+      this->remainder_wms_ = static_cast<uint32_t>(wms % WMS_PER_MWH);
+    } else if (this->has_last_ && dt > this->max_gap_ms_) {
+      this->gaps_++;
+    }
+    this->last_power_w_ = power_w;
+    this->last_ms_ = timestamp_ms;
+    this->has_last_ = true;
+    return increment;
+  }
+
+  uint32_t get_gap_count() const { return this->gaps_; }
+
+ protected:
+  uint32_t max_gap_ms_{120000};
+  float last_power_w_{0};
+  uint32_t last_ms_{0};
+  uint32_t remainder_wms_{0};
+  uint32_t gaps_{0};
+  bool has_last_{false};
+};
+
+// Счётчик энергии по периодам, мВт·ч: uint64_t не теряет приращений
+// ни при каком пробеге (float перестаёт расти уже на тысячах кВт·ч)
+struct EnergyCounter {
+  uint64_t mwh[ENERGY_PERIOD_COUNT]{};
+
+  void add(uint32_t delta_mwh) {
+    for (auto &value : this->mwh)
+      value += delta_mwh;
+  }
+  float kwh(EnergyPeriod period) const { return static_cast<float>(this->mwh[period] / 1e6); }
+  void set_kwh(EnergyPeriod period, float kwh) {
+    this->mwh[period] = std::isfinite(kwh) && kwh > 0 ? static_cast<uint64_t>(std::llround(kwh * 1e6)) : 0;
+  }
+};
+
+// ────────────────────────────────────────────────────────────────
+// Потоки энергии. Номер потока — его строка в сохраняемой записи,
+// поэтому новые потоки дописываются только в конец.
+// ────────────────────────────────────────────────────────────────
+enum EnergyFlow : uint8_t {
+  ENERGY_FLOW_SOLAR,
+  ENERGY_FLOW_INVERTER,
+  ENERGY_FLOW_BATTERY_CHARGE,
+  ENERGY_FLOW_BATTERY_DISCHARGE,
+  ENERGY_FLOW_GRID_TO_LOAD,
+  ENERGY_FLOW_COUNT,
+};
+
+// Поле кадра QPIGS как мощность/ток: не число и отрицательное — 0
+inline float qpigs_positive(const ResponseSnapshot &qpigs, EntitySlot slot) {
+  float value = qpigs.value(slot);
+  return std::isfinite(value) && value > 0 ? value : 0;
+}
+
+inline float battery_charge_power(const ResponseSnapshot &qpigs) {
+  return qpigs_positive(qpigs, SLOT_BATTERY_VOLTAGE) * qpigs_positive(qpigs, SLOT_BATTERY_CHARGING_CURRENT);
+}
+
+inline float battery_discharge_power(const ResponseSnapshot &qpigs) {
+  return qpigs_positive(qpigs, SLOT_BATTERY_VOLTAGE) * qpigs_positive(qpigs, SLOT_BATTERY_DISCHARGE_CURRENT);
+}
+
+// Сеть -> нагрузка: QPIGS не даёт мощности сети, поэтому это остаток
+// нагрузки после солнца (за вычетом заряда АКБ) и разряда АКБ. Потери
+// преобразования не учитываются — оценка, а не замер.
+inline float grid_to_load_power(const ResponseSnapshot &qpigs) {
+  float pv_to_load = qpigs_positive(qpigs, SLOT_PV_CHARGING_POWER) - battery_charge_power(qpigs);
+  float grid = qpigs_positive(qpigs, SLOT_OUTPUT_ACTIVE_POWER) - (pv_to_load > 0 ? pv_to_load : 0) -
+               battery_discharge_power(qpigs);
+  return grid > 0 ? grid : 0;
+}
+
+struct EnergyFlowDescriptor {
+  EnergyFlow flow;
+  const char *key;                                // имя в YAML (energy: - flow:)
+  float (*power)(const ResponseSnapshot &qpigs);  // мгновенная мощность, Вт
+  bool measured;  // мощность из кадра как есть; производные потоки не торопят запись во флеш
+};
+
+inline constexpr EnergyFlowDescriptor ENERGY_FLOWS[] = {
+    {ENERGY_FLOW_SOLAR, "solar", [](const ResponseSnapshot &q) { return q.value(SLOT_PV_CHARGING_POWER); }, true},
+    {ENERGY_FLOW_INVERTER, "inverter", [](const ResponseSnapshot &q) { return q.value(SLOT_OUTPUT_ACTIVE_POWER); },
+     true},
+    {ENERGY_FLOW_BATTERY_CHARGE, "battery_charge", battery_charge_power, false},
+    {ENERGY_FLOW_BATTERY_DISCHARGE, "battery_discharge", battery_discharge_power, false},
+    {ENERGY_FLOW_GRID_TO_LOAD, "grid_to_load", grid_to_load_power, false},
+};
+static_assert(std::size(ENERGY_FLOWS) == ENERGY_FLOW_COUNT, "ENERGY_FLOWS rows must match EnergyFlow");
+
+inline constexpr bool energy_flows_in_order() {
+  for (size_t i = 0; i < ENERGY_FLOW_COUNT; i++) {
+    if (ENERGY_FLOWS[i].flow != i)
+      return false;
+  }
+  return true;
+}
+static_assert(energy_flows_in_order(), "ENERGY_FLOWS rows must be in EnergyFlow order");
+
+// Состояние одного потока: интеграл, счётчики периодов и их сенсоры
+struct EnergyAccumulator {
+  EnergyIntegrator integrator;
+  EnergyCounter counter;
+  sensor::Sensor *sensors[ENERGY_PERIOD_COUNT]{};
+  uint64_t shown[ENERGY_PERIOD_COUNT];  // опубликованное значение в шагах accuracy_decimals
+
+  EnergyAccumulator() {
+    for (auto &value : this->shown)
+      value = UINT64_MAX;
+  }
+
+  // Публикация только тех периодов, у которых изменилось видимое
+  // значение (с точностью сенсора), а не на каждый кадр QPIGS
+  void publish() {
+    for (size_t period = 0; period < ENERGY_PERIOD_COUNT; period++) {
+      sensor::Sensor *sens = this->sensors[period];
+      if (sens == nullptr)
+        continue;
+      int8_t decimals = sens->get_accuracy_decimals();
+      uint64_t step = 1;  // мВт·ч на последний знак кВт·ч
+      for (int8_t d = decimals < 0 ? 0 : decimals; d < 6; d++)
+        step *= 10;
+      uint64_t shown = (this->counter.mwh[period] + step / 2) / step;
+      if (shown == this->shown[period])
+        continue;
+      this->shown[period] = shown;
+      sens->publish_state(this->counter.kwh(static_cast<EnergyPeriod>(period)));
+    }
+  }
+};
+
+// ────────────────────────────────────────────────────────────────
+// Сохраняемое состояние счётчиков одной упакованной записью.
+// Версия 1 — два потока (солнце, выход инвертора), версия 2 — пять
+// потоков; обе читаются один раз для переноса. Версия 3 хранит
+// ENERGY_RECORD_MAX_FLOWS потоков с запасом: новая строка ENERGY_FLOWS
+// занимает свободное место и не меняет ни длину записи, ни её ключ,
+// так что сохранённые счётчики не теряются.
+// ────────────────────────────────────────────────────────────────
+template<uint8_t Version, size_t Flows> struct __attribute__((packed)) EnergyRecordT {
+  static constexpr uint8_t VERSION = Version;
+  static constexpr size_t FLOWS = Flows;
+
+  uint32_t sequence;
+  uint8_t version;
+  uint8_t day;        // дата, к которой относятся today/month/year;
+  uint8_t month;      // 0 — часы не были синхронизированы
+  uint16_t year;
+  uint64_t mwh[Flows][ENERGY_PERIOD_COUNT];
+  uint16_t crc;       // CRC-16/XMODEM всех полей выше
+
+  uint16_t compute_crc() const {
+    auto *bytes = reinterpret_cast<const uint8_t *>(this);
+    uint16_t value = 0;
+    for (size_t i = 0; i < offsetof(EnergyRecordT, crc); i++)
+      value = crc_update(value, bytes[i]);
+    return value;
+  }
+};
+
+inline constexpr size_t ENERGY_RECORD_MAX_FLOWS = 8;
+static_assert(ENERGY_FLOW_COUNT <= ENERGY_RECORD_MAX_FLOWS, "ENERGY_FLOWS outgrew the energy record");
+
+using EnergyRecordV1 = EnergyRecordT<1, 2>;
+using EnergyRecordV2 = EnergyRecordT<2, 5>;
+using EnergyRecord = EnergyRecordT<3, ENERGY_RECORD_MAX_FLOWS>;
+
+// Ключи журналов: запись другой длины — другие ячейки
+inline constexpr uint32_t ENERGY_JOURNAL_V1_KEY = 0x6100;
+inline constexpr uint32_t ENERGY_JOURNAL_V2_KEY = 0x6110;
+inline constexpr uint32_t ENERGY_JOURNAL_KEY = 0x6120;
+
+// ────────────────────────────────────────────────────────────────
+// Журнал записей: кольцо из SLOTS ячеек настроек, каждая новая запись
+// пишется в следующую ячейку, так что износ делится между ними и
+// обрыв питания посреди записи портит не больше одной копии. При
+// загрузке берётся целая запись с наибольшим номером.
+// ────────────────────────────────────────────────────────────────
+template<typename Record> class EnergyJournal {
+ public:
+  static constexpr uint8_t SLOTS = 4;
+
+  void setup(uint32_t key_base) {
+    for (uint8_t i = 0; i < SLOTS; i++)
+      this->slots_[i] = global_preferences->make_preference<Record>(key_base + i, true);
+  }
+
+  // Самая новая целая запись; false — журнал пуст
+  bool load(Record &out) {
+    bool found = false;
+    for (uint8_t i = 0; i < SLOTS; i++) {
+      Record record;
+      if (!this->slots_[i].load(&record) || record.version != Record::VERSION ||
+          record.crc != record.compute_crc())
+        continue;
+      if (!found || static_cast<int32_t>(record.sequence - out.sequence) > 0) {
+        out = record;
+        this->next_slot_ = (i + 1) % SLOTS;
+        found = true;
+      }
+    }
+    if (found)
+      this->sequence_ = out.sequence;
+    return found;
+  }
+
+  // Дописать запись (номер, версия и CRC проставляются здесь)
+  bool append(Record &record) {
+    record.sequence = ++this->sequence_;
+    record.version = Record::VERSION;
+    record.crc = record.compute_crc();
+    bool ok = this->slots_[this->next_slot_].save(&record);
+    this->next_slot_ = (this->next_slot_ + 1) % SLOTS;
+    return ok;
+  }
+
+  uint32_t get_sequence() const { return this->sequence_; }
+
+ protected:
+  ESPPreferenceObject slots_[SLOTS];
+  uint32_t sequence_{0};
+  uint8_t next_slot_{0};
+};
+
+}  // namespace solar_inverter
+}  // namespace esphome
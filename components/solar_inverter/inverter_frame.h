@@ -0,0 +1,382 @@
+// inverter_frame.h
+#pragma once
+
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+namespace esphome {
+namespace solar_inverter {
+
+// ────────────────────────────────────────────────────────────────
+// CRC-16/XMODEM, как в протоколе инвертора. Побайтовая таблица
+// строится при компиляции; функции constexpr, чтобы кадры постоянных
+// команд опроса собирались компилятором (COMMAND_FRAMES ниже).
+// ────────────────────────────────────────────────────────────────
+struct CrcTable {
+  uint16_t entry[256];
+};
+
+constexpr CrcTable make_crc_table() {
+  CrcTable table{};
+  for (uint16_t i = 0; i < 256; i++) {
+    uint16_t crc = i << 8;
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+    table.entry[i] = crc;
+  }
+  return table;
+}
+
+inline constexpr CrcTable CRC_TABLE = make_crc_table();
+
+constexpr uint16_t crc_update(uint16_t crc, uint8_t byte) {
+  return static_cast<uint16_t>((crc << 8) ^ CRC_TABLE.entry[(crc >> 8) ^ byte]);
+}
+
+// Байты CRC не должны совпадать с '(' , '\r', '\n' — инвертор их инкрементирует
+constexpr uint16_t crc_escape(uint16_t crc) {
+  uint8_t lo = crc & 0xFF;
+  uint8_t hi = (crc >> 8) & 0xFF;
+  if (lo == 0x28 || lo == 0x0d || lo == 0x0a) lo++;
+  if (hi == 0x28 || hi == 0x0d || hi == 0x0a) hi++;
+  return static_cast<uint16_t>((hi << 8) | lo);
+}
+
+// CRC команды в том виде, в каком она уходит в линию
+constexpr uint16_t command_crc(std::string_view cmd) {
+  uint16_t crc = 0;
+  for (char c : cmd)
+    crc = crc_update(crc, static_cast<uint8_t>(c));
+  return crc_escape(crc);
+}
+
+// ────────────────────────────────────────────────────────────────
+// Кадр запроса "<cmd><crc16>\r", готовый для одного write_array()
+// ────────────────────────────────────────────────────────────────
+struct CommandFrame {
+  static constexpr size_t MAX_LEN = 32;
+
+  uint8_t bytes[MAX_LEN];
+  uint8_t len;   // 0 — команда не помещается в кадр
+};
+
+constexpr CommandFrame make_command_frame(std::string_view cmd) {
+  CommandFrame frame{};
+  if (cmd.size() + 3 > CommandFrame::MAX_LEN)
+    return frame;
+  size_t n = 0;
+  for (char c : cmd)
+    frame.bytes[n++] = static_cast<uint8_t>(c);
+  uint16_t crc = command_crc(cmd);
+  frame.bytes[n++] = crc >> 8;
+  frame.bytes[n++] = crc & 0xFF;
+  frame.bytes[n++] = '\r';
+  frame.len = n;
+  return frame;
+}
+
+struct PrecomputedCommand {
+  std::string_view command;
+  CommandFrame frame;
+};
+
+constexpr PrecomputedCommand precompute_command(std::string_view cmd) { return {cmd, make_command_frame(cmd)}; }
+
+// Постоянные команды опроса — кадры собраны при компиляции
+inline constexpr PrecomputedCommand COMMAND_FRAMES[] = {
+    precompute_command("QPIGS"), precompute_command("QPIWS"), precompute_command("QMOD"),
+    precompute_command("QFLAG"), precompute_command("QPIRI"), precompute_command("QBEQI"),
+    precompute_command("QPI"),   precompute_command("QID"),
+};
+
+static_assert(COMMAND_FRAMES[0].frame.len == 8 && COMMAND_FRAMES[0].frame.bytes[5] == 0xB7 &&
+                  COMMAND_FRAMES[0].frame.bytes[6] == 0xA9,
+              "QPIGS<B7><A9><cr>");
+
+inline const CommandFrame *find_command_frame(std::string_view cmd) {
+  for (const auto &entry : COMMAND_FRAMES) {
+    if (entry.command == cmd)
+      return &entry.frame;
+  }
+  return nullptr;
+}
+
+// ────────────────────────────────────────────────────────────────
+// Разбор десятичных полей фиксированного формата (BBB.B, GG.GG, QQ0).
+// Без исключений, без кучи и без плавающей точки до последнего шага —
+// у ESP32-C3 нет FPU, а strtof разбирает экспоненты, inf/nan и локаль.
+// ────────────────────────────────────────────────────────────────
+enum ParseStatus : uint8_t {
+  PARSE_OK,
+  PARSE_EMPTY,
+  PARSE_INVALID,    // посторонний символ, вторая точка, нет цифр
+  PARSE_OVERFLOW,   // больше 9 значащих цифр
+};
+
+// "-12.34" -> mantissa = -1234, decimals = 2
+struct FixedPoint {
+  int32_t mantissa;
+  uint8_t decimals;
+
+  float to_float() const {
+    static const float POW10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f};
+    return this->mantissa / POW10[this->decimals];
+  }
+};
+
+inline ParseStatus parse_fixed(std::string_view s, FixedPoint &out) {
+  if (s.empty())
+    return PARSE_EMPTY;
+  size_t i = 0;
+  bool negative = false;
+  if (s[0] == '-' || s[0] == '+') {
+    negative = s[0] == '-';
+    i = 1;
+  }
+  uint32_t mantissa = 0;
+  uint8_t digits = 0;
+  uint8_t decimals = 0;
+  bool point = false;
+  bool any_digit = false;
+  for (; i < s.size(); i++) {
+    char c = s[i];
+    if (c == '.') {
+      if (point)
+        return PARSE_INVALID;
+      point = true;
+      continue;
+    }
+    uint8_t d = static_cast<uint8_t>(c - '0');
+    if (d > 9)
+      return PARSE_INVALID;
+    any_digit = true;
+    // Ведущие нули не занимают разрядов
+    if (mantissa != 0 || d != 0) {
+      if (++digits > 9)
+        return PARSE_OVERFLOW;
+    }
+    mantissa = mantissa * 10 + d;
+    if (point)
+      decimals++;
+  }
+  if (!any_digit)
+    return PARSE_INVALID;  // только знак и/или точка
+  if (decimals > 9)
+    return PARSE_OVERFLOW;
+  out.mantissa = negative ? -static_cast<int32_t>(mantissa) : static_cast<int32_t>(mantissa);
+  out.decimals = decimals;
+  return PARSE_OK;
+}
+
+// Сразу в целое с заданным числом знаков: ("53.1", 2) -> 5310, ("0.125", 2) -> 13,
+// ("0.149", 1) -> 1. Лишние знаки отбрасываются одним делением с округлением
+// от нуля — поразрядное округление дало бы 0.149 -> 0.15 -> 0.2.
+inline ParseStatus parse_scaled(std::string_view s, uint8_t decimals, int32_t &out) {
+  static constexpr int64_t POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+  FixedPoint fp;
+  ParseStatus status = parse_fixed(s, fp);
+  if (status != PARSE_OK)
+    return status;
+  int64_t value = fp.mantissa;
+  if (fp.decimals > decimals) {
+    int64_t divisor = POW10[fp.decimals - decimals];  // fp.decimals <= 9
+    int64_t magnitude = (value < 0 ? -value : value) + divisor / 2;
+    value = value < 0 ? -(magnitude / divisor) : magnitude / divisor;
+  } else {
+    // |mantissa| < 10^9, так что проверка на каждом шаге не даёт выйти за int64
+    for (uint8_t d = fp.decimals; d < decimals && value != 0; d++) {
+      value *= 10;
+      if (value > INT32_MAX || value < INT32_MIN)
+        return PARSE_OVERFLOW;
+    }
+  }
+  if (value > INT32_MAX || value < INT32_MIN)
+    return PARSE_OVERFLOW;
+  out = static_cast<int32_t>(value);
+  return PARSE_OK;
+}
+
+// ────────────────────────────────────────────────────────────────
+// Принятый кадр "(<payload><crc16><cr>" с уже разбитыми полями
+// ────────────────────────────────────────────────────────────────
+struct InverterFrame {
+  static constexpr size_t BUFFER_SIZE = 256;
+  static constexpr uint8_t MAX_FIELDS = 32;
+
+  uint8_t raw[BUFFER_SIZE];
+  size_t len{0};              // длина вместе с '(' , CRC и '\r'
+  bool crc_ok{false};
+  uint8_t field_count{0};
+  uint8_t field_start[MAX_FIELDS];
+  uint8_t field_end[MAX_FIELDS];
+
+  std::string_view payload() const {
+    if (this->len < 4) return {};
+    return {reinterpret_cast<const char *>(this->raw) + 1, this->len - 4};
+  }
+
+  std::string_view field(size_t i) const {
+    if (i >= this->field_count) return {};
+    return {reinterpret_cast<const char *>(this->raw) + this->field_start[i],
+            static_cast<size_t>(this->field_end[i] - this->field_start[i])};
+  }
+
+  // Числовое поле без обращения к куче
+  bool field_float(size_t i, float &value) const {
+    FixedPoint fp;
+    if (parse_fixed(this->field(i), fp) != PARSE_OK)
+      return false;
+    value = fp.to_float();
+    return true;
+  }
+
+  // Числовое поле как целое с заданным числом знаков после точки
+  ParseStatus field_scaled(size_t i, uint8_t decimals, int32_t &value) const {
+    return parse_scaled(this->field(i), decimals, value);
+  }
+};
+
+// ────────────────────────────────────────────────────────────────
+// Приёмник кадров поверх фиксированного буфера.
+// Байты подаются порциями (read_array), начало и конец кадра ищутся
+// через memchr; CRC и границы полей считаются по мере прихода байт,
+// так что к приходу '\r' кадр уже разобран. Куча не используется.
+// ────────────────────────────────────────────────────────────────
+class FrameReceiver {
+ public:
+  static constexpr size_t BUFFER_SIZE = InverterFrame::BUFFER_SIZE;
+  using FrameCallback = std::function<void(const InverterFrame &frame)>;
+
+  void set_frame_callback(FrameCallback cb) { this->frame_callback_ = cb; }
+  void set_interbyte_timeout(uint32_t ms) { this->interbyte_timeout_ms_ = ms; }
+
+  // Подать порцию байт, прочитанных из UART
+  void feed(const uint8_t *data, size_t len, uint32_t now) {
+    if (len == 0)
+      return;
+    this->last_byte_ms_ = now;
+
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
+    while (p < end) {
+      if (!this->receiving_) {
+        // Мусор до '(' отбрасываем целиком
+        auto *start = static_cast<const uint8_t *>(memchr(p, '(', end - p));
+        if (start == nullptr)
+          return;
+        this->begin_frame_();
+        p = start + 1;
+        continue;
+      }
+
+      auto *cr = static_cast<const uint8_t *>(memchr(p, '\r', end - p));
+      const uint8_t *lim = cr != nullptr ? cr + 1 : end;
+
+      // Новый '(' посреди кадра — ресинхронизация (CRC никогда не равен 0x28)
+      auto *open = static_cast<const uint8_t *>(memchr(p, '(', lim - p));
+      if (open != nullptr) {
+        this->resync_count_++;
+        this->receiving_ = false;
+        p = open;
+        continue;
+      }
+
+      size_t chunk = lim - p;
+      if (this->frame_.len + chunk > BUFFER_SIZE) {
+        this->overflow_count_++;
+        this->receiving_ = false;
+        p = lim;
+        continue;
+      }
+
+      const uint8_t *payload_end = cr != nullptr ? cr : lim;
+      for (; p < payload_end; p++)
+        this->push_byte_(*p);
+
+      if (cr != nullptr) {
+        this->frame_.raw[this->frame_.len++] = '\r';
+        p = lim;
+        this->finish_frame_();
+      }
+    }
+  }
+
+  // Сброс недособранного кадра, если байты перестали приходить.
+  // Возвращает true, если кадр был отброшен.
+  bool check_timeout(uint32_t now) {
+    if (!this->receiving_ || now - this->last_byte_ms_ <= this->interbyte_timeout_ms_)
+      return false;
+    this->timeout_count_++;
+    this->receiving_ = false;
+    return true;
+  }
+
+  // Отбросить недособранный кадр (перед отправкой новой команды)
+  void reset() { this->receiving_ = false; }
+
+  bool is_receiving() const { return this->receiving_; }
+  uint32_t get_overflow_count() const { return this->overflow_count_; }
+  uint32_t get_timeout_count() const { return this->timeout_count_; }
+  uint32_t get_resync_count() const { return this->resync_count_; }
+
+ protected:
+  void begin_frame_() {
+    this->receiving_ = true;
+    this->frame_.len = 0;
+    this->frame_.crc_ok = false;
+    this->frame_.field_count = 0;
+    this->frame_.field_start[0] = 1;
+    this->frame_.raw[this->frame_.len++] = '(';
+    this->crc_ = 0;
+  }
+
+  void push_byte_(uint8_t c) {
+    size_t i = this->frame_.len;
+    this->frame_.raw[this->frame_.len++] = c;
+    // CRC отстаёт на два байта: последние два перед '\r' — сама CRC
+    if (i >= 2)
+      this->crc_ = crc_update(this->crc_, this->frame_.raw[i - 2]);
+    // Разделитель полей; последнее поле закрывается в finish_frame_()
+    if (c == ' ' && this->frame_.field_count + 1 < InverterFrame::MAX_FIELDS) {
+      uint8_t n = this->frame_.field_count++;
+      this->frame_.field_end[n] = i;
+      this->frame_.field_start[n + 1] = i + 1;
+    }
+  }
+
+  void finish_frame_() {
+    this->receiving_ = false;
+    InverterFrame &f = this->frame_;
+    if (f.len >= 4) {
+      size_t payload_end = f.len - 3;
+      uint16_t received = (f.raw[f.len - 3] << 8) | f.raw[f.len - 2];
+      f.crc_ok = crc_escape(this->crc_) == received;
+      // Байт CRC, равный 0x20, мог быть принят за разделитель
+      while (f.field_count > 0 && f.field_end[f.field_count - 1] >= payload_end)
+        f.field_count--;
+      f.field_start[f.field_count] = f.field_count == 0 ? 1 : f.field_end[f.field_count - 1] + 1;
+      f.field_end[f.field_count] = payload_end;
+      f.field_count++;
+    }
+    if (this->frame_callback_)
+      this->frame_callback_(f);
+  }
+
+  InverterFrame frame_;
+  uint16_t crc_{0};
+  bool receiving_{false};
+  uint32_t last_byte_ms_{0};
+  uint32_t interbyte_timeout_ms_{500};
+
+  uint32_t overflow_count_{0};   // кадр длиннее BUFFER_SIZE
+  uint32_t timeout_count_{0};    // пауза между байтами внутри кадра
+  uint32_t resync_count_{0};     // новый '(' до '\r'
+
+  FrameCallback frame_callback_;
+};
+
+}  // namespace solar_inverter
+}  // namespace esphome
@@ -0,0 +1,216 @@
+#include "inverter_history.h"
+
+#ifdef USE_SOLAR_INVERTER_HISTORY
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include "esphome/core/log.h"
+#include "inverter_frame.h"
+
+namespace esphome {
+namespace solar_inverter {
+
+static const char *const TAG = "solar_inverter.history";
+
+uint16_t HistoryDay::compute_crc() const {
+  auto *bytes = reinterpret_cast<const uint8_t *>(this);
+  uint16_t value = 0;
+  for (size_t i = 0; i < offsetof(HistoryDay, crc); i++)
+    value = crc_update(value, bytes[i]);
+  return value;
+}
+
+// ────────────────────────────────────────────────────────────────
+// Хранилище
+// ────────────────────────────────────────────────────────────────
+void EnergyHistory::setup() {
+  for (uint8_t i = 0; i < this->days_; i++)
+    this->slots_[i] = global_preferences->make_preference<HistoryDay>(KEY_BASE + i, true);
+}
+
+void EnergyHistory::add(time_t now, uint32_t solar_mwh, uint32_t load_mwh) {
+  struct tm local;
+  ::localtime_r(&now, &local);
+  int32_t day = days_from_civil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+
+  if (day != this->current_.day || local.tm_hour != this->hour_) {
+    this->commit_hour_();
+    if (day != this->current_.day) {
+      this->hour_mwh_[0] = this->hour_mwh_[1] = 0;
+      // После перезагрузки в те же сутки продолжаем сохранённую запись
+      if (!this->read_day(day, this->current_)) {
+        this->current_ = HistoryDay{};
+        this->current_.day = day;
+      }
+    }
+    this->hour_ = local.tm_hour;
+  }
+  this->hour_mwh_[0] += solar_mwh;
+  this->hour_mwh_[1] += load_mwh;
+}
+
+void EnergyHistory::commit_hour_() {
+  if (this->current_.day == 0 || this->hour_ < 0)
+    return;
+  // Целые Вт·ч — в ячейку часа, остаток остаётся на следующий
+  uint32_t solar = this->current_.solar_wh[this->hour_] + this->hour_mwh_[0] / 1000;
+  uint32_t load = this->current_.load_wh[this->hour_] + this->hour_mwh_[1] / 1000;
+  this->current_.solar_wh[this->hour_] = std::min<uint32_t>(solar, UINT16_MAX);
+  this->current_.load_wh[this->hour_] = std::min<uint32_t>(load, UINT16_MAX);
+  this->hour_mwh_[0] %= 1000;
+  this->hour_mwh_[1] %= 1000;
+  this->current_.crc = this->current_.compute_crc();
+  if (!this->slots_[this->current_.day % this->days_].save(&this->current_))
+    ESP_LOGW(TAG, "Не вдалося записати історію за добу %d", this->current_.day);
+}
+
+void EnergyHistory::flush() { this->commit_hour_(); }
+
+bool EnergyHistory::read_day(int32_t day, HistoryDay &out) {
+  if (day <= 0)
+    return false;
+  if (day == this->current_.day && &out != &this->current_) {
+    out = this->current_;
+    return true;
+  }
+  HistoryDay stored;
+  if (!this->slots_[day % this->days_].load(&stored) || stored.day != day || stored.crc != stored.compute_crc())
+    return false;
+  out = stored;
+  return true;
+}
+
+// ────────────────────────────────────────────────────────────────
+// HTTP
+// ────────────────────────────────────────────────────────────────
+bool EnergyHistoryHandler::canHandle(AsyncWebServerRequest *request) {
+  if (request->method() != HTTP_GET)
+    return false;
+  return request->url() == CSV_PATH || request->url() == BIN_PATH;
+}
+
+void EnergyHistoryHandler::handleRequest(AsyncWebServerRequest *request) {
+  bool binary = request->url() == BIN_PATH;
+  auto stream = this->history_->open_stream(binary);
+  AsyncWebServerResponse *response =
+      request->beginChunkedResponse(binary ? "application/octet-stream" : "text/csv",
+                                    [stream](uint8_t *buffer, size_t max_len, size_t index) -> size_t {
+                                      return stream->read(buffer, max_len);
+                                    });
+  request->send(response);
+}
+
+std::shared_ptr<HistoryStream> EnergyHistory::open_stream(bool binary) {
+  auto stream = std::make_shared<HistoryStream>(binary);
+  LockGuard guard(this->streams_lock_);
+  this->streams_.push_back(stream);
+  return stream;
+}
+
+void EnergyHistory::loop() {
+  // Ссылки забираются под замком, флеш читается уже без него;
+  // ответы сверх pending ждут, пока освободится место
+  std::shared_ptr<HistoryStream> pending[4];
+  size_t count = 0;
+  {
+    LockGuard guard(this->streams_lock_);
+    auto it = this->streams_.begin();
+    while (it != this->streams_.end()) {
+      std::shared_ptr<HistoryStream> stream = it->lock();
+      // Ответ отправлен или клиент отключился
+      if (stream == nullptr || stream->is_done()) {
+        it = this->streams_.erase(it);
+        continue;
+      }
+      if (count < std::size(pending))
+        pending[count++] = std::move(stream);
+      ++it;
+    }
+  }
+  for (size_t i = 0; i < count; i++)
+    pending[i]->fill_batch(*this);
+}
+
+void HistoryStream::fill_batch(EnergyHistory &history) {
+  if (this->state_.load(std::memory_order_acquire) != STREAM_WANT)
+    return;
+  if (!this->started_) {
+    this->started_ = true;
+    this->last_day_ = history.get_today();
+    this->next_day_ = this->last_day_ - history.get_days() + 1;
+  }
+  this->batch_count_ = 0;
+  while (this->batch_count_ < BATCH_DAYS && this->last_day_ > 0 && this->next_day_ <= this->last_day_) {
+    int32_t day = this->next_day_++;
+    if (!history.read_day(day, this->batch_[this->batch_count_]))
+      continue;
+    // Текущие сутки — только до текущего часа включительно
+    this->batch_hours_[this->batch_count_] = day == this->last_day_ ? history.get_hour() + 1 : HistoryDay::HOURS;
+    this->batch_count_++;
+  }
+  this->last_batch_ = this->last_day_ <= 0 || this->next_day_ > this->last_day_;
+  this->state_.store(this->batch_count_ == 0 && this->last_batch_ ? STREAM_DONE : STREAM_READY,
+                     std::memory_order_release);
+}
+
+size_t HistoryStream::read(uint8_t *buffer, size_t max_len) {
+  size_t written = 0;
+  while (written < max_len) {
+    if (this->sent_ == this->staged_) {
+      this->sent_ = this->staged_ = 0;
+      if (!this->fill_())
+        break;
+    }
+    size_t n = std::min(max_len - written, this->staged_ - this->sent_);
+    memcpy(buffer + written, this->staging_ + this->sent_, n);
+    this->sent_ += n;
+    written += n;
+  }
+  if (written == 0 && this->state_.load(std::memory_order_acquire) == STREAM_WANT)
+    return RESPONSE_TRY_AGAIN;
+  return written;
+}
+
+bool HistoryStream::fill_() {
+  if (!this->binary_ && !this->header_sent_) {
+    this->header_sent_ = true;
+    this->staged_ = snprintf(reinterpret_cast<char *>(this->staging_), sizeof(this->staging_), "time,solar_wh,load_wh\n");
+    return true;
+  }
+  // Следующие сутки из пачки; пачка кончилась — вернуть её основному циклу
+  while (this->hour_ >= this->last_hour_) {
+    if (this->state_.load(std::memory_order_acquire) != STREAM_READY)
+      return false;
+    if (this->batch_pos_ == this->batch_count_) {
+      this->batch_pos_ = 0;
+      this->state_.store(this->last_batch_ ? STREAM_DONE : STREAM_WANT, std::memory_order_release);
+      return false;
+    }
+    uint8_t i = this->batch_pos_++;
+    this->record_ = this->batch_[i];
+    this->hour_ = 0;
+    this->last_hour_ = this->batch_hours_[i];
+    if (this->binary_) {
+      memcpy(this->staging_, &this->record_, sizeof(HistoryDay));
+      this->staged_ = sizeof(HistoryDay);
+      this->hour_ = this->last_hour_;
+      return true;
+    }
+  }
+  int y, m, d;
+  civil_from_days(this->record_.day, y, m, d);
+  uint8_t h = this->hour_++;
+  this->staged_ = snprintf(reinterpret_cast<char *>(this->staging_), sizeof(this->staging_),
+                           "%04d-%02d-%02d %02u:00,%u,%u\n", y, m, d, h, this->record_.solar_wh[h],
+                           this->record_.load_wh[h]);
+  return true;
+}
+
+}  // namespace solar_inverter
+}  // namespace esphome
+
+#endif  // USE_SOLAR_INVERTER_HISTORY
@@ -0,0 +1,171 @@
+// inverter_history.h
+#pragma once
+
+#include "esphome/core/defines.h"
+#ifdef USE_SOLAR_INVERTER_HISTORY
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <vector>
+#include "esphome/core/helpers.h"
+#include "esphome/core/preferences.h"
+#include "esphome/components/web_server_base/web_server_base.h"
+
+namespace esphome {
+namespace solar_inverter {
+
+// Дни от 1970-01-01 <-> дата (алгоритм Хиннанта, без таблиц и time.h)
+constexpr int32_t days_from_civil(int y, int m, int d) {
+  y -= m <= 2;
+  const int era = (y >= 0 ? y : y - 399) / 400;
+  const int yoe = y - era * 400;
+  const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+inline void civil_from_days(int32_t z, int &y, int &m, int &d) {
+  z += 719468;
+  const int era = (z >= 0 ? z : z - 146096) / 146097;
+  const int doe = z - era * 146097;
+  const int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const int mp = (5 * doy + 2) / 153;
+  d = doy - (153 * mp + 2) / 5 + 1;
+  m = mp < 10 ? mp + 3 : mp - 9;
+  y = yoe + era * 400 + (m <= 2);
+}
+
+static_assert(days_from_civil(1970, 1, 1) == 0, "epoch");
+static_assert(days_from_civil(2024, 3, 1) == 19783, "leap year");
+
+// Сутки почасовой истории: одна ячейка настроек
+struct __attribute__((packed)) HistoryDay {
+  static constexpr uint8_t HOURS = 24;
+
+  int32_t day;                  // days_from_civil() по местному времени; 0 — ячейка пуста
+  uint16_t solar_wh[HOURS];
+  uint16_t load_wh[HOURS];
+  uint16_t crc;                 // CRC-16/XMODEM полей выше
+
+  uint16_t compute_crc() const;
+};
+
+class HistoryStream;
+
+// ────────────────────────────────────────────────────────────────
+// Почасовая энергия (солнце / нагрузка) за последние days суток.
+// Кольцо ячеек настроек по номеру дня; текущие сутки держатся в
+// памяти и записываются раз в час — 24 записи в сутки на ячейку.
+// Всё, кроме open_stream(), — только из основного цикла.
+// ────────────────────────────────────────────────────────────────
+class EnergyHistory {
+ public:
+  static constexpr uint8_t MAX_DAYS = 90;   // больше ~47 суток — только с увеличенным разделом NVS
+  static constexpr uint32_t KEY_BASE = 0x6200;
+
+  void set_days(uint8_t days) { this->days_ = days < 1 ? 1 : (days > MAX_DAYS ? MAX_DAYS : days); }
+  uint8_t get_days() const { return this->days_; }
+
+  void setup();
+  // Прирост энергии за интервал, закончившийся в now (часы синхронизированы)
+  void add(time_t now, uint32_t solar_mwh, uint32_t load_mwh);
+  // Дописать накопленное в текущий час и сохранить сутки
+  void flush();
+
+  int32_t get_today() const { return this->current_.day; }
+  int8_t get_hour() const { return this->hour_; }
+  // Сутки по номеру; false — нет данных (не записаны или затёрты)
+  bool read_day(int32_t day, HistoryDay &out);
+
+  // Из задачи AsyncTCP: новый ответ; данные для него готовит loop()
+  std::shared_ptr<HistoryStream> open_stream(bool binary);
+  // Основной цикл: подготовить следующие сутки для открытых ответов
+  void loop();
+
+ protected:
+  void commit_hour_();
+
+  Mutex streams_lock_;
+  std::vector<std::weak_ptr<HistoryStream>> streams_;   // под streams_lock_
+
+  ESPPreferenceObject slots_[MAX_DAYS];
+  HistoryDay current_{};
+  uint8_t days_{30};
+  int8_t hour_{-1};
+  uint32_t hour_mwh_[2]{};      // ещё не перенесённое в ячейку часа (< 1 Вт·ч остаётся)
+};
+
+// ────────────────────────────────────────────────────────────────
+// Выгрузка истории: GET /energy_history.csv и /energy_history.bin
+// (сырые записи HistoryDay). Обработчик работает в задаче AsyncTCP и
+// не трогает ни current_, ни флеш: сутки копирует основной цикл
+// пачками по BATCH_DAYS, ответ идёт частями из этой пачки — куча не
+// растёт с глубиной истории.
+// ────────────────────────────────────────────────────────────────
+class EnergyHistoryHandler : public AsyncWebHandler {
+ public:
+  static constexpr const char *CSV_PATH = "/energy_history.csv";
+  static constexpr const char *BIN_PATH = "/energy_history.bin";
+
+  explicit EnergyHistoryHandler(EnergyHistory *history) : history_(history) {}
+
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+  bool isRequestHandlerTrivial() override { return false; }
+
+ protected:
+  EnergyHistory *history_;
+};
+
+// Состояние одного ответа: от самых старых суток к текущим.
+// Пачку пишет основной цикл в STREAM_WANT, читает AsyncTCP в
+// STREAM_READY; смена состояния — граница владения пачкой.
+class HistoryStream {
+ public:
+  static constexpr uint8_t BATCH_DAYS = 8;
+
+  explicit HistoryStream(bool binary) : binary_(binary) {}
+
+  // AsyncTCP: следующая часть ответа; RESPONSE_TRY_AGAIN — пачка ещё не готова
+  size_t read(uint8_t *buffer, size_t max_len);
+  // Основной цикл: следующая пачка, если ответ её ждёт
+  void fill_batch(EnergyHistory &history);
+  bool is_done() const { return this->state_.load(std::memory_order_acquire) == STREAM_DONE; }
+
+ protected:
+  enum State : uint8_t { STREAM_WANT, STREAM_READY, STREAM_DONE };
+
+  bool fill_();   // следующая строка/запись в staging_; false — конец или ждём пачку
+
+  std::atomic<uint8_t> state_{STREAM_WANT};
+  bool binary_;
+
+  // Основной цикл
+  bool started_{false};
+  int32_t next_day_{0};
+  int32_t last_day_{0};
+
+  // Пачка: пишет основной цикл, читает AsyncTCP (см. state_)
+  HistoryDay batch_[BATCH_DAYS];
+  uint8_t batch_hours_[BATCH_DAYS];   // часов к выдаче: у текущих суток — до текущего
+  uint8_t batch_count_{0};
+  bool last_batch_{false};
+
+  // AsyncTCP
+  uint8_t batch_pos_{0};
+  bool header_sent_{false};
+  uint8_t hour_{HistoryDay::HOURS};
+  uint8_t last_hour_{HistoryDay::HOURS};
+  HistoryDay record_{};
+  uint8_t staging_[sizeof(HistoryDay)];
+  size_t staged_{0};
+  size_t sent_{0};
+};
+
+}  // namespace solar_inverter
+}  // namespace esphome
+
+#endif  // USE_SOLAR_INVERTER_HISTORY
@@ -27,7 +27,8 @@ namespace solar_inverter {
           std::string cmd = this->cmd_prefix_ + std::string(val_buf);
           ESP_LOGD("inverter_number", "Отправка команды: %s", cmd.c_str());
       
-          this->parent_->send_priority_command(cmd);
+          this->target_ = value;
+          this->parent_->begin_write(this, cmd);
         }
       
         this->publish_state(value);
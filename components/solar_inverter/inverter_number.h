@@ -1,17 +1,26 @@
 #pragma once
 #include "esphome/components/number/number.h"
+#include "inverter_write.h"
+#include <cmath>
 
 namespace esphome {
 namespace solar_inverter {
 
 class SolarInverter;
 
-class InverterNumber : public number::Number, public number::NumberTraits {
+class InverterNumber : public number::Number, public number::NumberTraits, public InverterWritable {
  public:
   void set_parent(SolarInverter *parent) { parent_ = parent; }
   void set_command_prefix(const std::string &p) { cmd_prefix_ = p; }
   void set_format(const std::string &f) { format_ = f; }
   void set_state_from_inverter(float value) {
+    last_reported_ = value;
+    has_reported_ = true;
+    // Пока запись не подтверждена, старое значение не затирает новое
+    if (this->write_in_flight()) {
+      this->report_from_inverter_(std::fabs(value - target_) <= this->match_tolerance_());
+      return;
+    }
     is_from_inverter_ = true;
     this->publish_state(value);
     is_from_inverter_ = false;
@@ -24,10 +33,25 @@ class InverterNumber : public number::Number, public number::NumberTraits {
   }
 
  protected:
+  void rollback_() override {
+    if (!has_reported_)
+      return;
+    is_from_inverter_ = true;
+    this->publish_state(last_reported_);
+    is_from_inverter_ = false;
+  }
+  float match_tolerance_() const {
+    float step = this->traits.get_step();
+    return step > 0 ? step / 2 : 0.01f;
+  }
+
   SolarInverter *parent_{nullptr};
   std::string cmd_prefix_;
   std::string format_{"%s%03d"};
   bool is_from_inverter_{false};
+  float target_{NAN};          // записываемое значение
+  float last_reported_{NAN};   // последнее значение от инвертора
+  bool has_reported_{false};
 };
 
 }  // namespace solar_inverter
@@ -2,11 +2,12 @@
 #pragma once
 
 #include "esphome/components/select/select.h"
+#include "inverter_write.h"
 
 namespace esphome {
 namespace solar_inverter {
 
-  class InverterSelect : public select::Select {
+  class InverterSelect : public select::Select, public InverterWritable {
     public:
      using UserSelectCallback = std::function<void(const std::string &)>;
      void set_command_prefix(const std::string &prefix) { this->command_prefix_ = prefix; }
@@ -27,7 +28,30 @@ namespace solar_inverter {
        this->publish_state(value);
      }
    
+    // Код параметра, который сейчас записывается (для подтверждения чтением)
+    void set_write_target(const std::string &parameter_code) { this->target_code_ = parameter_code; }
+
     void update_state_from_inverter(const std::string &parameter_code) {
+      this->last_reported_code_ = parameter_code;
+      // Пока запись не подтверждена, старое значение не затирает новое
+      if (this->write_in_flight()) {
+        this->report_from_inverter_(parameter_code == this->target_code_);
+        return;
+      }
+      this->publish_from_inverter_(parameter_code);
+    }
+   
+     void set_on_user_select_callback(UserSelectCallback cb) {
+       this->on_user_select_callback_ = cb;
+     }
+   
+    protected:
+    void rollback_() override {
+      if (!this->last_reported_code_.empty())
+        this->publish_from_inverter_(this->last_reported_code_);
+    }
+
+    void publish_from_inverter_(const std::string &parameter_code) {
       internal_update_ = true;  // чтобы не вызвать callback пользователя при обновлении из инвертора
       auto it = std::find(parameters_.begin(), parameters_.end(), parameter_code);
       if (it != parameters_.end()) {
@@ -42,17 +66,14 @@ namespace solar_inverter {
       }
       internal_update_ = false;
     }
-   
-     void set_on_user_select_callback(UserSelectCallback cb) {
-       this->on_user_select_callback_ = cb;
-     }
-   
-    protected:
+
      std::string command_prefix_;
      std::vector<std::string> parameters_;
      std::vector<std::string> options_;
      std::string field_name_;
      bool internal_update_ = false;
+     std::string target_code_;
+     std::string last_reported_code_;
      UserSelectCallback on_user_select_callback_;
    };
 
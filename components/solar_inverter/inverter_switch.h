@@ -1,24 +1,43 @@
 #pragma once
 
 #include "esphome/components/switch/switch.h"
+#include "inverter_write.h"
 
 namespace esphome {
 namespace solar_inverter {
 
-    class InverterSwitch : public switch_::Switch {
+    class InverterSwitch : public switch_::Switch, public InverterWritable {
         public:
          bool internal_update_{false};
          using CommandCallback = std::function<void(bool)>;
        
          void set_command_callback(CommandCallback cb) { command_callback_ = cb; }
        
+         // Состояние, которое сейчас записывается (для подтверждения чтением)
+         void set_write_target(bool state) { target_ = state; }
+
          void update_state_from_inverter(bool state) {
+           last_reported_ = state;
+           has_reported_ = true;
+           // Пока запись не подтверждена, старое значение не затирает новое
+           if (this->write_in_flight()) {
+             this->report_from_inverter_(state == target_);
+             return;
+           }
            internal_update_ = true;
            this->publish_state(state);
            internal_update_ = false;
          }
        
         protected:
+         void rollback_() override {
+           if (!has_reported_)
+             return;
+           internal_update_ = true;
+           this->publish_state(last_reported_);
+           internal_update_ = false;
+         }
+
          void write_state(bool state) override {
            // Это вызов при ручном управлении
            if (!internal_update_) {
@@ -30,6 +49,10 @@ namespace solar_inverter {
            // Если internal_update_ == true, значит обновление из инвертора — не вызываем callback
          }
        
+         bool target_{false};
+         bool last_reported_{false};
+         bool has_reported_{false};
+
         private:
          CommandCallback command_callback_;
        };
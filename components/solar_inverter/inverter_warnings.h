@@ -0,0 +1,72 @@
+// inverter_warnings.h
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+namespace esphome {
+namespace solar_inverter {
+
+// Известный бит QPIWS (символ с номером bit в ответе)
+struct WarningDescriptor {
+  uint8_t bit;
+  const char *key;       // имя в YAML (warnings:)
+  const char *message;
+};
+
+inline constexpr WarningDescriptor QPIWS_WARNINGS[] = {
+    {0, "inverter_fault", "Inverter fault / Overcharge current"},
+    {1, "battery_over_temperature", "Battery over-temperature"},
+    {2, "battery_under_voltage", "Battery under-voltage"},
+    {3, "battery_over_voltage", "Battery over-voltage"},
+    {4, "pv_over_voltage", "PV input over-voltage"},
+    {5, "battery_temp_too_low", "Battery temp too low"},
+    {6, "battery_temp_too_high", "Battery temp too high"},
+    // 7..19 — резерв
+    {20, "pv_low_loss", "PV low loss warning"},
+    {21, "pv_derating", "PV derating (high PV)"},
+    {22, "temperature_derating", "Derating (high temp)"},
+    {23, "battery_temperature_low", "Battery temperature low warning"},
+    {24, "battery_disconnect", "Battery disconnect"},
+    // 25..29 — резерв
+    {30, "battery_low", "Battery low warning"},
+    {31, "load_short_circuit", "Load short circuit fault"},
+    {32, "dsp_communication_fault", "DSP communication fault"},
+};
+inline constexpr size_t WARNING_COUNT = std::size(QPIWS_WARNINGS);
+
+// Строка таблицы по номеру бита; WARNING_COUNT — бит не описан
+inline constexpr size_t warning_row(uint8_t bit) {
+  for (size_t row = 0; row < WARNING_COUNT; row++) {
+    if (QPIWS_WARNINGS[row].bit == bit)
+      return row;
+  }
+  return WARNING_COUNT;
+}
+
+// Ответ QPIWS "0010…": символ i -> бит i маски
+inline bool parse_warning_mask(std::string_view bits, uint64_t &mask) {
+  if (bits.empty() || bits.size() > 64)
+    return false;
+  uint64_t value = 0;
+  for (size_t i = 0; i < bits.size(); i++) {
+    if (bits[i] == '1')
+      value |= uint64_t(1) << i;
+    else if (bits[i] != '0')
+      return false;
+  }
+  mask = value;
+  return true;
+}
+
+// История одного предупреждения (время — millis())
+struct WarningStats {
+  uint32_t first_seen_ms;     // самое первое появление
+  uint32_t last_seen_ms;      // начало текущего/последнего появления
+  uint32_t last_cleared_ms;   // последнее исчезновение; 0 — ещё не было
+  uint32_t occurrences;       // сколько раз появлялось
+};
+
+}  // namespace solar_inverter
+}  // namespace esphome
@@ -0,0 +1,57 @@
+// inverter_write.h
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace esphome {
+namespace solar_inverter {
+
+class SolarInverter;
+
+// Состояние записи параметра в инвертор
+enum WriteState : uint8_t {
+  WRITE_IDLE,       // нет незавершённой записи
+  WRITE_PENDING,    // команда в очереди/на линии, ждём ACK
+  WRITE_READBACK,   // ACK получен, ждём совпадающего значения из ответа-запроса
+  WRITE_BACKOFF,    // ошибка, ждём повторной попытки
+};
+
+// ────────────────────────────────────────────────────────────────
+// Общая часть сущностей, пишущих в инвертор (number, select, switch).
+// Запись подтверждается только ACK + совпавшим значением при повторном
+// чтении; иначе — повтор с нарастающей паузой и откат к последнему
+// значению, которое сообщил инвертор. Саму последовательность ведёт
+// SolarInverter::begin_write().
+// ────────────────────────────────────────────────────────────────
+class InverterWritable {
+ public:
+  void set_readback_command(const std::string &cmd) { this->readback_command_ = cmd; }
+  const std::string &get_readback_command() const { return this->readback_command_; }
+
+  WriteState get_write_state() const { return this->write_state_; }
+  bool write_in_flight() const { return this->write_state_ != WRITE_IDLE; }
+  uint32_t get_write_failures() const { return this->write_failures_; }
+
+ protected:
+  friend class SolarInverter;
+
+  // Вернуть сущности последнее значение, сообщённое инвертором
+  virtual void rollback_() = 0;
+
+  // Вызывается сущностью при каждом обновлении из инвертора;
+  // matches — значение совпало с записываемым
+  void report_from_inverter_(bool matches);
+
+  SolarInverter *writer_{nullptr};
+  std::string readback_command_;
+  std::string write_command_;
+  WriteState write_state_{WRITE_IDLE};
+  uint8_t write_attempts_{0};
+  uint8_t readback_mismatches_{0};
+  uint32_t write_seq_{0};       // номер попытки: ответы на устаревшие попытки игнорируются
+  uint32_t write_failures_{0};
+};
+
+}  // namespace solar_inverter
+}  // namespace esphome
@@ -0,0 +1,23 @@
+//poll_profile_select.h
+#pragma once
+
+#include "esphome/components/select/select.h"
+
+namespace esphome {
+namespace solar_inverter {
+
+  class SolarInverter;
+
+  // Выбор профиля опроса; само переключение делает SolarInverter::set_poll_profile()
+  class PollProfileSelect : public select::Select {
+    public:
+     void set_parent(SolarInverter *parent) { this->parent_ = parent; }
+
+    protected:
+     void control(const std::string &value) override;
+
+     SolarInverter *parent_{nullptr};
+   };
+
+}  // namespace solar_inverter
+}  // namespace esphome
@@ -4,8 +4,8 @@
 
 #include "solar_inverter.h"
 #include "esphome/core/time.h"
-#include <sstream>
-#include <set>
+#include <algorithm>
+#include <cmath>
 #include "esphome/core/preferences.h"
 
 namespace esphome {
@@ -13,67 +13,117 @@ namespace solar_inverter {
 
 static const char *const TAG = "solar_inverter";
 
+const char *command_result_to_string(CommandResult result) {
+  switch (result) {
+    case COMMAND_RESPONSE: return "RESPONSE";
+    case COMMAND_ACK: return "ACK";
+    case COMMAND_NAK: return "NAK";
+    case COMMAND_TIMEOUT: return "TIMEOUT";
+    case COMMAND_CRC_ERROR: return "CRC_ERROR";
+    case COMMAND_SUPERSEDED: return "SUPERSEDED";
+    case COMMAND_DROPPED: return "DROPPED";
+    case COMMAND_UNEXPECTED: return "UNEXPECTED";
+    default: return "UNKNOWN";
+  }
+}
+
+const char *link_state_to_string(LinkState state) {
+  switch (state) {
+    case LINK_ONLINE: return "online";
+    case LINK_DEGRADED: return "degraded";
+    case LINK_OFFLINE: return "offline";
+    default: return "unknown";
+  }
+}
+
 // ────────────────────────────────────────────────────────────────
 // setup()
 // ────────────────────────────────────────────────────────────────
 void SolarInverter::setup() {
   ESP_LOGI(TAG, "Ініціалізація інвертора...");
 
-  poll_commands_ = {
-      {"QPIRI", 3000, 0},
-      {"QMOD",  3000, 0},
-      {"QPIGS", 1000, 0},
-      {"QFLAG", 3000, 0},
-      {"QPIWS", 1000, 0},
-      {"QBEQI", 3000, 0},
-  };
-  
+  // Таблица опроса по умолчанию, если в YAML не задан список poll:
+  // только команды, разбор которых собран в прошивку
+  if (poll_defaults_.empty()) {
+    poll_defaults_ = {
+#ifdef USE_SOLAR_INVERTER_QPIRI
+        {"QPIRI", 3000, true},
+#endif
+#ifdef USE_SOLAR_INVERTER_QMOD
+        {"QMOD",  3000, true},
+#endif
+        {"QPIGS", 1000, true},
+#ifdef USE_SOLAR_INVERTER_QFLAG
+        {"QFLAG", 3000, true},
+#endif
+#ifdef USE_SOLAR_INVERTER_QPIWS
+        {"QPIWS", 1000, true},
+#endif
+#ifdef USE_SOLAR_INVERTER_QBEQI
+        {"QBEQI", 3000, true},
+#endif
+    };
+  }
+  apply_poll_profile_(nullptr);
+
   send_priority_command("QPI");
   send_priority_command("QID");
-  
 
   ready_ = false;
   current_command_.clear();
   state_ = IDLE;
-  poll_index_ = 0;
   
-  this->pref_solar_total_ = global_preferences->make_preference<float>(0x6000);
-  this->pref_inverter_total_ = global_preferences->make_preference<float>(0x6001);
-  this->pref_solar_year_ = global_preferences->make_preference<float>(0x6002);
-  this->pref_inverter_year_ = global_preferences->make_preference<float>(0x6003);
-  this->pref_solar_month_ = global_preferences->make_preference<float>(0x6004);
-  this->pref_inverter_month_ = global_preferences->make_preference<float>(0x6005);
-  this->pref_solar_today_ = global_preferences->make_preference<float>(0x6006);
-  this->pref_inverter_today_ = global_preferences->make_preference<float>(0x6007);
-
+  energy_journal_.setup(ENERGY_JOURNAL_KEY);
   load_energy_from_eeprom_();
+#ifdef USE_SOLAR_INVERTER_HISTORY
+  energy_history_.setup();
+  if (energy_history_base_ != nullptr) {
+    energy_history_base_->init();
+    energy_history_base_->add_handler(new EnergyHistoryHandler(&energy_history_));  // NOLINT
+  }
+#endif
 
+#ifdef USE_SOLAR_INVERTER_QFLAG
   setup_qflag_switches();
+#endif
+
+  rx_.set_interbyte_timeout(RX_INTERBYTE_TIMEOUT_MS);
+  rx_.set_frame_callback([this](const InverterFrame &frame) { this->process_raw_response(frame); });
+
+  this->set_timeout("start_commands", 3000, [this]() {
+    this->reset_poll_schedule_();
+    this->ready_ = true;
+  });
+  if (!poll_diagnostics_.empty() || poll_rate_sensor_ != nullptr)
+    this->set_interval("poll_stats", POLL_STATS_INTERVAL_MS, [this]() { this->publish_poll_stats_(); });
+
+  if (poll_profile_select_ != nullptr)
+    poll_profile_select_->publish_state(active_poll_profile_);
 
-  this->set_timeout("start_commands", 3000, [this]() { this->ready_ = true; });
+  link_state_since_ms_ = millis();
+  if (link_state_text_sensor_ != nullptr)
+    link_state_text_sensor_->publish_state(link_state_to_string(link_state_));
+  if (link_state_duration_sensor_ != nullptr)
+    this->set_interval("link_state", LINK_STATS_INTERVAL_MS, [this]() { this->publish_link_state_duration_(); });
 }
 
 // ────────────────────────────────────────────────────────────────
 // loop()
 // ────────────────────────────────────────────────────────────────
 void SolarInverter::loop() {
-  // ─── UART приём ───
-  while (available()) {
-    char c = read();
-    if (!receiving_) {
-      if (c == '(') {
-        receiving_ = true;
-        rx_buffer_.clear();
-        rx_buffer_ += c;
-      }
-      continue;
-    }
-    rx_buffer_ += c;
-    if (c == '\r') {
-      receiving_ = false;
-      process_raw_response(rx_buffer_);
-      rx_buffer_.clear();
-    }
+  // ─── UART приём: блоками в фиксированный буфер ───
+  uint32_t now = millis();
+  uint8_t chunk[RX_CHUNK_SIZE];
+  int avail;
+  while ((avail = available()) > 0) {
+    size_t n = std::min<size_t>(avail, sizeof(chunk));
+    if (!read_array(chunk, n))
+      break;
+    rx_.feed(chunk, n, now);
+  }
+  if (rx_.check_timeout(now)) {
+    ESP_LOGW(TAG, "Обрив кадру для команди [%s] (таймаутів: %u, переповнень: %u, ресинхр.: %u)",
+             current_command_.c_str(), rx_.get_timeout_count(), rx_.get_overflow_count(), rx_.get_resync_count());
   }
 
   if (!ready_)
@@ -86,34 +136,25 @@ void SolarInverter::loop() {
   }
 
   // ─── Таймаут ответа ───
-  if (state_ == WAITING_RESPONSE && millis() - last_send_ > RESPONSE_TIMEOUT_MS) {
-    ESP_LOGW(TAG, "Таймаут для команди %s", current_command_.c_str());
-    state_ = IDLE;
-    current_command_.clear();
+  // (пока кадр ещё идёт по линии, его обрыв ловит rx_.check_timeout())
+  if (state_ == WAITING_RESPONSE && !rx_.is_receiving() && millis() - last_send_ > response_timeout_ms_) {
+    if (link_state_ != LINK_OFFLINE)
+      ESP_LOGW(TAG, "Таймаут для команди %s (%u мс)", current_command_.c_str(), response_timeout_ms_);
+    ResponseTimeStats &stats = response_times_[command_key_(current_command_)];
+    if (stats.timeouts < UINT8_MAX)
+      stats.timeouts++;
+    finish_transaction_(COMMAND_TIMEOUT, {});
+    link_timeout_();
     next_command_();
   }
 
-  // ─── Обработка очереди результатов (парсинг) ───
-  if (!pending_results_.empty()) {
-    auto &res = pending_results_.front();
-    process_result(res.command, res.payload);
-    pending_results_.pop();
-  }
-
-  // ─── Публикация QPIGS по частям ───
-  if (qpigs_ready_) {
-    publish_next_qpigs_chunk_();
-  }
-  // ─── Публикация QBEQI по частям ───
-  if (qbeqi_ready_) {
-    publish_next_qbeqi_chunk_();
-  }
-  // ─── Публикация QPIRI по частям ───
-  if (qpiri_ready_) {
-    publish_next_qpiri_chunk_();
-  }
+  // ─── Публикация QPIGS / QBEQI / QPIRI в пределах бюджета времени ───
+  publish_pending_fields_();
   // ─── Обновление интеграции энергии и истории ───
   update_energy_history_();
+#ifdef USE_SOLAR_INVERTER_HISTORY
+  energy_history_.loop();
+#endif
 
   // ─── Запуск новой команды, если можно ───
   if (state_ == IDLE) {
@@ -122,129 +163,201 @@ void SolarInverter::loop() {
 }
 
 // ────────────────────────────────────────────────────────────────
-// Обновление интеграции энергии и истории
+// Обновление интеграции энергии и истории: по каждому новому кадру
+// QPIGS, от отметки времени предыдущего кадра (метод трапеций)
 // ────────────────────────────────────────────────────────────────
 void SolarInverter::update_energy_history_() {
-  static uint32_t last_update = 0;
-  static uint32_t last_day = 0, last_month = 0, last_year = 0;
-  static uint32_t last_loop_time = 0;
-  static uint32_t last_save_time = 0;
-
-  uint32_t now = millis();
-
-  // Обновляем раз в секунду
-  if (now - last_update < 1000)
+  const ResponseSnapshot &qpigs = this->get_qpigs_snapshot();
+  if (qpigs.sequence == 0 || qpigs.sequence == energy_sequence_)
     return;
+  energy_sequence_ = qpigs.sequence;
 
-  last_update = now;
-
-  // Получаем дату (реализуйте get_current_date())
+  // Сброс счётчиков при смене дня/месяца/года; пока часы не
+  // синхронизированы, энергия идёт в текущие периоды
   Date current_date = this->get_current_date();
-
-  // Сброс счётчиков при смене дня/месяца/года
-  if (current_date.day != last_day) {
-    last_day = current_date.day;
-    accumulated_energy_solar_today_ = 0.0f;
-    accumulated_energy_inverter_today_ = 0.0f;
+  bool clock_valid = current_date.year >= ENERGY_MIN_VALID_YEAR;
+  if (clock_valid && last_year_ < 0) {
+    // Дата счётчиков неизвестна (перенос из float-ключей, запись до
+    // синхронизации часов): считаем их текущими, а не обнуляем
+    last_day_ = current_date.day;
+    last_month_ = current_date.month;
+    last_year_ = current_date.year;
+  }
+  if (clock_valid && current_date.day != last_day_) {
+    last_day_ = current_date.day;
+    for (auto &acc : energy_)
+      acc.counter.mwh[ENERGY_TODAY] = 0;
     ESP_LOGI(TAG, "Сброс энергии за день");
   }
-  if (current_date.month != last_month) {
-    last_month = current_date.month;
-    accumulated_energy_solar_month_ = 0.0f;
-    accumulated_energy_inverter_month_ = 0.0f;
+  if (clock_valid && current_date.month != last_month_) {
+    last_month_ = current_date.month;
+    for (auto &acc : energy_)
+      acc.counter.mwh[ENERGY_MONTH] = 0;
     ESP_LOGI(TAG, "Сброс энергии за месяц");
   }
-  if (current_date.year != last_year) {
-    last_year = current_date.year;
-    accumulated_energy_solar_year_ = 0.0f;
-    accumulated_energy_inverter_year_ = 0.0f;
+  if (clock_valid && current_date.year != last_year_) {
+    last_year_ = current_date.year;
+    for (auto &acc : energy_)
+      acc.counter.mwh[ENERGY_YEAR] = 0;
     ESP_LOGI(TAG, "Сброс энергии за год");
   }
 
-  // Интервал в часах для интеграции
-  if (last_loop_time == 0) {
-    last_loop_time = now;
-    return;  // пропускаем первый вызов
+  // Все потоки — за один проход по одному кадру, с его временем приёма
+  uint32_t increments[ENERGY_FLOW_COUNT];
+  uint32_t gaps = energy_[ENERGY_FLOW_SOLAR].integrator.get_gap_count();
+  for (const auto &desc : ENERGY_FLOWS) {
+    EnergyAccumulator &acc = energy_[desc.flow];
+    increments[desc.flow] = acc.integrator.add_sample(desc.power(qpigs), qpigs.received_ms);
+    acc.counter.add(increments[desc.flow]);
+    acc.publish();
   }
+  if (energy_[ENERGY_FLOW_SOLAR].integrator.get_gap_count() != gaps)
+    ESP_LOGW(TAG, "Пропуск у даних QPIGS, інтервал не враховано в енергії");
+#ifdef USE_SOLAR_INVERTER_HISTORY
+  if (clock_valid) {
+    // Час — по времени приёма кадра, а не обработки: кадр, принятый в
+    // 13:59:59 и разобранный позже, остаётся в 13-м часу
+    time_t received = ::time(nullptr) - static_cast<time_t>((millis() - qpigs.received_ms) / 1000);
+    energy_history_.add(received, increments[ENERGY_FLOW_SOLAR], increments[ENERGY_FLOW_INVERTER]);
+  }
+#endif
+
+  // Запись, когда измеряемый поток (солнце, выход) прирос на
+  // energy_save_delta, или по времени, если накопилось хоть что-то.
+  // Производные потоки повторяют ту же энергию (заряд АКБ — часть
+  // солнца, сеть — часть выхода) и порог не сдвигают. Каждая запись
+  // сразу уходит во флеш (save_energy_to_eeprom_), так что при обрыве
+  // питания теряется не больше delta на поток либо то, что набежало
+  // за интервал.
+  uint32_t now = millis();
+  if (energy_unsaved_mwh_(true) >= energy_save_delta_mwh_ ||
+      (energy_unsaved_mwh_(false) > 0 && now - last_energy_save_ms_ >= energy_save_interval_ms_))
+    save_energy_to_eeprom_();
+}
 
-  float dt_hours = (now - last_loop_time) / 3600000.0f;
-  last_loop_time = now;
+void SolarInverter::on_shutdown() {
+  // OTA, перезагрузка из HA, safe mode: недописанное — в журнал и сразу во флеш
+  if (energy_unsaved_mwh_(false) > 0)
+    save_energy_to_eeprom_();
+#ifdef USE_SOLAR_INVERTER_HISTORY
+  energy_history_.flush();
+#endif
+  global_preferences->sync();
+}
 
-  // Интеграция мощности в энергию (кВт·ч)
-  if (this->pv_charging_power_sensor_ != nullptr) {
-    float pv_power = this->pv_charging_power_sensor_->state;
-    if (pv_power >= 0) {
-      float energy_kwh = (pv_power / 1000.0f) * dt_hours;
-      accumulated_energy_solar_today_ += energy_kwh;
-      accumulated_energy_solar_month_ += energy_kwh;
-      accumulated_energy_solar_year_ += energy_kwh;
-      accumulated_energy_solar_total_ += energy_kwh;
-    }
+// Наибольший прирост total одного потока с последней записи
+uint64_t SolarInverter::energy_unsaved_mwh_(bool measured_only) const {
+  uint64_t unsaved = 0;
+  for (const auto &desc : ENERGY_FLOWS) {
+    if (measured_only && !desc.measured)
+      continue;
+    unsaved = std::max(unsaved, energy_[desc.flow].counter.mwh[ENERGY_TOTAL] - energy_saved_mwh_[desc.flow]);
   }
+  return unsaved;
+}
 
-  if (this->output_active_power_sensor_ != nullptr) {
-    float inv_power = this->output_active_power_sensor_->state;
-    if (inv_power >= 0) {
-      float energy_kwh = (inv_power / 1000.0f) * dt_hours;
-      accumulated_energy_inverter_today_ += energy_kwh;
-      accumulated_energy_inverter_month_ += energy_kwh;
-      accumulated_energy_inverter_year_ += energy_kwh;
-      accumulated_energy_inverter_total_ += energy_kwh;
-    }
-  }
+void SolarInverter::mark_energy_saved_() {
+  for (size_t flow = 0; flow < ENERGY_FLOW_COUNT; flow++)
+    energy_saved_mwh_[flow] = energy_[flow].counter.mwh[ENERGY_TOTAL];
+}
 
-  // Публикация накопленных значений в сенсоры
-  if (this->energy_solar_today_sensor_ != nullptr)
-    this->energy_solar_today_sensor_->publish_state(accumulated_energy_solar_today_);
-  if (this->energy_solar_month_sensor_ != nullptr)
-    this->energy_solar_month_sensor_->publish_state(accumulated_energy_solar_month_);
-  if (this->energy_solar_year_sensor_ != nullptr)
-    this->energy_solar_year_sensor_->publish_state(accumulated_energy_solar_year_);
-  if (this->energy_solar_total_sensor_ != nullptr)
-    this->energy_solar_total_sensor_->publish_state(accumulated_energy_solar_total_);
-
-  if (this->energy_inverter_today_sensor_ != nullptr)
-    this->energy_inverter_today_sensor_->publish_state(accumulated_energy_inverter_today_);
-  if (this->energy_inverter_month_sensor_ != nullptr)
-    this->energy_inverter_month_sensor_->publish_state(accumulated_energy_inverter_month_);
-  if (this->energy_inverter_year_sensor_ != nullptr)
-    this->energy_inverter_year_sensor_->publish_state(accumulated_energy_inverter_year_);
-  if (this->energy_inverter_total_sensor_ != nullptr)
-    this->energy_inverter_total_sensor_->publish_state(accumulated_energy_inverter_total_);
-
-  // Сохраняем общий накопленный (total) в EEPROM раз в минуту
-  if (now - last_save_time >= 60000) {
-    last_save_time = now;
-    save_energy_to_eeprom_();
+// Счётчики и дата из записи журнала любой версии: потоков в записи
+// может быть меньше, чем в ENERGY_FLOWS, — остальные начинаются с нуля
+template<typename Record> static void restore_energy(const Record &record, EnergyAccumulator *energy, int &day,
+                                                     int &month, int &year) {
+  for (size_t flow = 0; flow < Record::FLOWS && flow < ENERGY_FLOW_COUNT; flow++) {
+    for (size_t i = 0; i < ENERGY_PERIOD_COUNT; i++)
+      energy[flow].counter.mwh[i] = record.mwh[flow][i];
+  }
+  // Периоды продолжаются, если за время простоя дата не сменилась
+  if (record.day != 0) {
+    day = record.day;
+    month = record.month;
+    year = record.year;
   }
 }
 
+// Журнал прежней версии, читается один раз для переноса
+template<typename Record> static bool load_energy_journal(uint32_t key, EnergyAccumulator *energy, int &day,
+                                                          int &month, int &year) {
+  EnergyJournal<Record> journal;
+  journal.setup(key);
+  Record record;
+  if (!journal.load(record))
+    return false;
+  restore_energy(record, energy, day, month, year);
+  return true;
+}
 
 void SolarInverter::load_energy_from_eeprom_() {
-  pref_solar_total_.load(&accumulated_energy_solar_total_);
-  pref_inverter_total_.load(&accumulated_energy_inverter_total_);
-  pref_solar_year_.load(&accumulated_energy_solar_year_);
-  pref_inverter_year_.load(&accumulated_energy_inverter_year_);
-  pref_solar_month_.load(&accumulated_energy_solar_month_);
-  pref_inverter_month_.load(&accumulated_energy_inverter_month_);
-  pref_solar_today_.load(&accumulated_energy_solar_today_);
-  pref_inverter_today_.load(&accumulated_energy_inverter_today_);
-  ESP_LOGI(TAG, "Завантажено з NVS: total S=%.2f, I=%.2f", accumulated_energy_solar_total_, accumulated_energy_inverter_total_);
+  EnergyRecord record;
+  if (energy_journal_.load(record)) {
+    restore_energy(record, energy_, last_day_, last_month_, last_year_);
+    ESP_LOGI(TAG, "Завантажено журнал енергії #%u: total S=%.3f, I=%.3f кВт·год", record.sequence,
+             energy_[ENERGY_FLOW_SOLAR].counter.kwh(ENERGY_TOTAL),
+             energy_[ENERGY_FLOW_INVERTER].counter.kwh(ENERGY_TOTAL));
+  } else if (load_energy_journal<EnergyRecordV2>(ENERGY_JOURNAL_V2_KEY, energy_, last_day_, last_month_, last_year_) ||
+             load_energy_journal<EnergyRecordV1>(ENERGY_JOURNAL_V1_KEY, energy_, last_day_, last_month_, last_year_) ||
+             load_legacy_energy_()) {
+    ESP_LOGI(TAG, "Перенесено лічильники зі старого формату: total S=%.2f, I=%.2f",
+             energy_[ENERGY_FLOW_SOLAR].counter.kwh(ENERGY_TOTAL),
+             energy_[ENERGY_FLOW_INVERTER].counter.kwh(ENERGY_TOTAL));
+    save_energy_to_eeprom_();
+  }
+  mark_energy_saved_();
 }
 
+// Прежний формат: восемь отдельных float в кВт·ч
+bool SolarInverter::load_legacy_energy_() {
+  struct LegacySlot {
+    uint32_t key;
+    EnergyCounter *counter;
+    EnergyPeriod period;
+  };
+  EnergyCounter &solar = energy_[ENERGY_FLOW_SOLAR].counter;
+  EnergyCounter &inverter = energy_[ENERGY_FLOW_INVERTER].counter;
+  const LegacySlot slots[] = {
+      {0x6000, &solar, ENERGY_TOTAL}, {0x6001, &inverter, ENERGY_TOTAL},
+      {0x6002, &solar, ENERGY_YEAR},  {0x6003, &inverter, ENERGY_YEAR},
+      {0x6004, &solar, ENERGY_MONTH}, {0x6005, &inverter, ENERGY_MONTH},
+      {0x6006, &solar, ENERGY_TODAY}, {0x6007, &inverter, ENERGY_TODAY},
+  };
+  bool found = false;
+  for (const auto &slot : slots) {
+    ESPPreferenceObject pref = global_preferences->make_preference<float>(slot.key);
+    float kwh = 0;
+    if (pref.load(&kwh)) {
+      slot.counter->set_kwh(slot.period, kwh);
+      found = true;
+    }
+  }
+  return found;
+}
 
 void SolarInverter::save_energy_to_eeprom_() {
-  pref_solar_total_.save(&accumulated_energy_solar_total_);
-  pref_inverter_total_.save(&accumulated_energy_inverter_total_);
-  pref_solar_year_.save(&accumulated_energy_solar_year_);
-  pref_inverter_year_.save(&accumulated_energy_inverter_year_);
-  pref_solar_month_.save(&accumulated_energy_solar_month_);
-  pref_inverter_month_.save(&accumulated_energy_inverter_month_);
-  pref_solar_today_.save(&accumulated_energy_solar_today_);
-  pref_inverter_today_.save(&accumulated_energy_inverter_today_);
-  ESP_LOGD(TAG, "Збережено в NVS (S=%.2f/%.2f/%.2f, I=%.2f/%.2f/%.2f)",
-           accumulated_energy_solar_today_, accumulated_energy_solar_month_, accumulated_energy_solar_year_,
-           accumulated_energy_inverter_today_, accumulated_energy_inverter_month_, accumulated_energy_inverter_year_);
+  EnergyRecord record{};
+  for (size_t flow = 0; flow < ENERGY_FLOW_COUNT; flow++) {
+    for (size_t i = 0; i < ENERGY_PERIOD_COUNT; i++)
+      record.mwh[flow][i] = energy_[flow].counter.mwh[i];
+  }
+  if (last_day_ > 0) {
+    record.day = last_day_;
+    record.month = last_month_;
+    record.year = last_year_;
+  }
+  // save() лишь ставит запись в очередь настроек; sync() пишет её во
+  // флеш сейчас, иначе очередная ячейка кольца жила бы в RAM до
+  // общего сброса и обрыв питания стирал бы больше, чем delta
+  if (!energy_journal_.append(record) || !global_preferences->sync())
+    ESP_LOGW(TAG, "Не вдалося записати журнал енергії");
+  mark_energy_saved_();
+  last_energy_save_ms_ = millis();
+  ESP_LOGD(TAG, "Журнал енергії #%u", record.sequence);
+  for (const auto &desc : ENERGY_FLOWS) {
+    const EnergyCounter &counter = energy_[desc.flow].counter;
+    ESP_LOGD(TAG, "  %s: %.3f/%.3f/%.3f/%.3f кВт·год", desc.key, counter.kwh(ENERGY_TODAY),
+             counter.kwh(ENERGY_MONTH), counter.kwh(ENERGY_YEAR), counter.kwh(ENERGY_TOTAL));
+  }
 }
 
 
@@ -261,185 +374,837 @@ Date SolarInverter::get_current_date() {
 // ────────────────────────────────────────────────────────────────
 // Отправка и планирование команд
 // ────────────────────────────────────────────────────────────────
-void SolarInverter::send_priority_command(const std::string &cmd) {
-  priority_commands_.push(cmd);
+// Запись в уже ожидающий параметр заменяет прежнюю (побеждает последняя),
+// повторный запрос сливается с ожидающим — очередь не растёт от слайдера
+void SolarInverter::submit_command(const std::string &cmd, CommandCallback callback) {
+  std::string key = command_key_(cmd);
+  for (auto &pending : priority_commands_) {
+    if (pending.key != key)
+      continue;
+    if (pending.command == cmd) {
+      // Тот же запрос уже ждёт — один ответ получат оба
+      if (callback) {
+        if (pending.callback) {
+          auto first = std::move(pending.callback);
+          pending.callback = [first, callback](CommandResult r, std::string_view p) {
+            first(r, p);
+            callback(r, p);
+          };
+        } else {
+          pending.callback = callback;
+        }
+      }
+      return;
+    }
+    ESP_LOGD(TAG, "Команду %s замінено на %s", pending.command.c_str(), cmd.c_str());
+    auto superseded = std::move(pending.callback);
+    pending.command = cmd;
+    pending.callback = callback;
+    if (superseded)
+      superseded(COMMAND_SUPERSEDED, {});
+    return;
+  }
+  if (link_state_ == LINK_OFFLINE) {
+    ESP_LOGW(TAG, "Немає зв'язку з інвертором, %s відкинуто", cmd.c_str());
+    if (callback)
+      callback(COMMAND_DROPPED, {});
+    return;
+  }
+  if (priority_commands_.size() >= MAX_PRIORITY_COMMANDS) {
+    ESP_LOGW(TAG, "Черга команд переповнена, %s відкинуто", cmd.c_str());
+    if (callback)
+      callback(COMMAND_DROPPED, {});
+    return;
+  }
+  priority_commands_.push_back({key, cmd, callback});
+}
+
+// Ключ целевого параметра: PEa/PDa -> "P*a", PBCV48.0 -> "PBCV", запросы Q* — как есть
+std::string SolarInverter::command_key_(const std::string &cmd) {
+  if (cmd.empty() || cmd[0] == 'Q')
+    return cmd;
+  if (cmd.size() == 3 && cmd[0] == 'P' && (cmd[1] == 'E' || cmd[1] == 'D'))
+    return std::string("P*") + cmd[2];
+  size_t end = cmd.size();
+  while (end > 1 && (isdigit(static_cast<unsigned char>(cmd[end - 1])) || cmd[end - 1] == '.' || cmd[end - 1] == ' '))
+    end--;
+  return cmd.substr(0, end);
 }
 
 void SolarInverter::next_command_() {
   if (state_ != IDLE || !current_command_.empty())
     return;
 
-  if (!priority_commands_.empty()) {
-    current_command_ = priority_commands_.front();
-    priority_commands_.pop();
-  } else {
-    const size_t sz = poll_commands_.size();
+  if (link_state_ == LINK_OFFLINE) {
+    // Без связи — только пробный запрос с растущей паузой
     uint32_t now = millis();
-    for (size_t i = 0; i < sz; i++) {
-      auto &cmd = poll_commands_[poll_index_];
-      poll_index_ = (poll_index_ + 1) % sz;
-      if (cmd.last_run_ms == 0 || now - cmd.last_run_ms >= cmd.interval_ms) {
-        cmd.last_run_ms = now;
-        current_command_ = cmd.command;
-        break;
-      }
+    if (now - last_probe_ms_ < probe_interval_ms_)
+      return;
+    last_probe_ms_ = now;
+    current_command_ = LINK_PROBE_COMMAND;
+  } else if (!priority_commands_.empty()) {
+    current_command_ = std::move(priority_commands_.front().command);
+    current_callback_ = std::move(priority_commands_.front().callback);
+    priority_commands_.pop_front();
+  } else if (!poll_heap_.empty()) {
+    // Earliest-deadline-first: в вершине кучи — самая просроченная команда
+    auto later = [this](uint8_t a, uint8_t b) { return poll_due_later_(a, b); };
+    uint32_t now = millis();
+    auto &cmd = poll_commands_[poll_heap_.front()];
+    if (static_cast<int32_t>(now - cmd.next_due_ms) >= 0) {
+      std::pop_heap(poll_heap_.begin(), poll_heap_.end(), later);
+      update_poll_stats_(cmd, now);
+      current_command_ = cmd.command;
+      std::push_heap(poll_heap_.begin(), poll_heap_.end(), later);
     }
   }
 
   if (!current_command_.empty()) {
+    rx_.reset();  // хвост опоздавшего ответа не должен достаться новой команде
     send_command(current_command_);
     state_ = WAITING_RESPONSE;
   }
 }
 
+// Вне очереди опроса: QPIRI может быть выключен активным профилем
+void SolarInverter::request_qpiri_refresh() {
+  if (!qpiri_event_driven_)
+    return;
+  ESP_LOGD(TAG, "Позачергове оновлення QPIRI");
+  send_priority_command("QPIRI");
+}
+
+// ────────────────────────────────────────────────────────────────
+// Запись с подтверждением
+//   PENDING  → ACK → READBACK → совпало → IDLE
+//   NAK / таймаут / нет совпадения → BACKOFF → повтор (до WRITE_MAX_ATTEMPTS)
+//   попытки исчерпаны → откат сущности к значению из инвертора
+// ────────────────────────────────────────────────────────────────
+void SolarInverter::begin_write(InverterWritable *entity, const std::string &cmd) {
+  std::string key = command_key_(cmd);
+  // Новое значение отменяет паузу/ожидание предыдущей записи этой сущности
+  cancel_timeout("wr_" + key);
+  cancel_timeout("rb_" + key);
+  entity->writer_ = this;
+  entity->write_command_ = cmd;
+  entity->write_attempts_ = 0;
+  send_write_attempt_(entity);
+}
+
+void SolarInverter::send_write_attempt_(InverterWritable *entity) {
+  entity->write_state_ = WRITE_PENDING;
+  entity->write_attempts_++;
+  uint32_t seq = ++entity->write_seq_;
+  ESP_LOGD(TAG, "Запис %s, спроба %u", entity->write_command_.c_str(), entity->write_attempts_);
+  submit_command(entity->write_command_, [this, entity, seq](CommandResult result, std::string_view) {
+    this->on_write_result_(entity, seq, result);
+  });
+}
+
+void SolarInverter::on_write_result_(InverterWritable *entity, uint32_t seq, CommandResult result) {
+  // Ответ на устаревшую попытку или команду заменило новое значение
+  if (seq != entity->write_seq_ || entity->write_state_ != WRITE_PENDING || result == COMMAND_SUPERSEDED)
+    return;
+  if (result != COMMAND_ACK) {
+    write_failed_(entity, command_result_to_string(result));
+    return;
+  }
+
+  const std::string &readback = entity->readback_command_;
+  if (readback.empty()) {
+    entity->write_state_ = WRITE_IDLE;
+    return;
+  }
+  entity->write_state_ = WRITE_READBACK;
+  entity->readback_mismatches_ = 0;
+  // Всегда приоритетной командой: от таблицы опроса и профиля не зависит
+  send_priority_command(readback);
+
+  set_timeout("rb_" + command_key_(entity->write_command_), WRITE_READBACK_TIMEOUT_MS, [this, entity, seq]() {
+    if (seq == entity->write_seq_ && entity->write_state_ == WRITE_READBACK)
+      this->write_failed_(entity, "no read-back");
+  });
+}
+
+void SolarInverter::on_write_readback_(InverterWritable *entity, bool matches) {
+  if (!matches) {
+    // Первое несовпадение может прийти из кадра, принятого до ACK
+    if (++entity->readback_mismatches_ >= 2)
+      write_failed_(entity, "read-back mismatch");
+    return;
+  }
+  cancel_timeout("rb_" + command_key_(entity->write_command_));
+  entity->write_state_ = WRITE_IDLE;
+  ESP_LOGD(TAG, "Запис %s підтверджено", entity->write_command_.c_str());
+}
+
+void SolarInverter::write_failed_(InverterWritable *entity, const char *reason) {
+  std::string key = command_key_(entity->write_command_);
+  cancel_timeout("rb_" + key);
+  entity->write_failures_++;
+
+  if (entity->write_attempts_ < WRITE_MAX_ATTEMPTS) {
+    uint32_t delay = WRITE_BACKOFF_MS << (entity->write_attempts_ - 1);
+    ESP_LOGW(TAG, "Запис %s не вдався (%s), повтор через %u мс", entity->write_command_.c_str(), reason, delay);
+    entity->write_state_ = WRITE_BACKOFF;
+    set_timeout("wr_" + key, delay, [this, entity]() { this->send_write_attempt_(entity); });
+    return;
+  }
+
+  ESP_LOGW(TAG, "Запис %s не вдався (%s) після %u спроб, відкат", entity->write_command_.c_str(), reason,
+           entity->write_attempts_);
+  entity->write_state_ = WRITE_IDLE;
+  entity->write_attempts_ = 0;
+  entity->rollback_();
+}
+
+void InverterWritable::report_from_inverter_(bool matches) {
+  if (this->write_state_ == WRITE_READBACK && this->writer_ != nullptr)
+    this->writer_->on_write_readback_(this, matches);
+}
+
+// Команда a наступает позже b (сравнение устойчиво к переполнению millis())
+bool SolarInverter::poll_due_later_(uint8_t a, uint8_t b) const {
+  return static_cast<int32_t>(poll_commands_[a].next_due_ms - poll_commands_[b].next_due_ms) > 0;
+}
+
+void SolarInverter::reset_poll_schedule_() {
+  uint32_t now = millis();
+  for (auto &cmd : poll_commands_) {
+    cmd.next_due_ms = now;
+    cmd.last_run_ms = 0;
+  }
+  rebuild_poll_heap_();
+}
+
+void SolarInverter::rebuild_poll_heap_() {
+  poll_heap_.clear();
+  for (size_t i = 0; i < poll_commands_.size(); i++) {
+    if (poll_commands_[i].enabled)
+      poll_heap_.push_back(i);
+  }
+  std::make_heap(poll_heap_.begin(), poll_heap_.end(),
+                 [this](uint8_t a, uint8_t b) { return poll_due_later_(a, b); });
+}
+
+// ────────────────────────────────────────────────────────────────
+// Таблица и профили опроса
+// ────────────────────────────────────────────────────────────────
+void SolarInverter::add_poll_command(const std::string &cmd, uint32_t interval_ms, bool enabled) {
+  poll_defaults_.push_back({cmd, interval_ms, enabled});
+}
+
+void SolarInverter::add_poll_profile(const std::string &name, uint32_t interval_ms, uint32_t duration_ms) {
+  poll_profiles_.push_back({name, interval_ms, duration_ms, {}});
+}
+
+void SolarInverter::add_poll_profile_override(const std::string &profile, const std::string &cmd,
+                                              uint32_t interval_ms, bool enabled) {
+  for (auto &p : poll_profiles_) {
+    if (p.name == profile) {
+      p.overrides.push_back({cmd, interval_ms, enabled});
+      return;
+    }
+  }
+  ESP_LOGW(TAG, "Невідомий профіль опитування %s", profile.c_str());
+}
+
+bool SolarInverter::set_poll_profile(const std::string &name) {
+  const PollProfile *profile = nullptr;
+  if (name != POLL_PROFILE_DEFAULT) {
+    for (auto &p : poll_profiles_) {
+      if (p.name == name)
+        profile = &p;
+    }
+    if (profile == nullptr) {
+      ESP_LOGW(TAG, "Невідомий профіль опитування %s", name.c_str());
+      return false;
+    }
+  }
+
+  this->cancel_timeout("poll_profile");
+  apply_poll_profile_(profile);
+  active_poll_profile_ = name;
+  ESP_LOGI(TAG, "Профіль опитування: %s", name.c_str());
+
+  if (profile != nullptr && profile->duration_ms != 0) {
+    this->set_timeout("poll_profile", profile->duration_ms,
+                      [this]() { this->set_poll_profile(POLL_PROFILE_DEFAULT); });
+  }
+  if (poll_profile_select_ != nullptr)
+    poll_profile_select_->publish_state(name);
+  return true;
+}
+
+// Таблица по умолчанию + профиль поверх неё; статистика команд сохраняется
+void SolarInverter::apply_poll_profile_(const PollProfile *profile) {
+  auto entry_for = [this](const std::string &command) -> CommandEntry & {
+    for (auto &e : poll_commands_) {
+      if (e.command == command)
+        return e;
+    }
+    poll_commands_.push_back({command, 0, 0});
+    return poll_commands_.back();
+  };
+  auto apply = [&](const PollSetting &s, uint32_t interval_ms) {
+    CommandEntry &e = entry_for(s.command);
+    e.interval_ms = interval_ms;
+    e.enabled = s.enabled;
+  };
+
+  for (auto &e : poll_commands_)
+    e.enabled = false;
+  for (auto &s : poll_defaults_)
+    apply(s, profile != nullptr && profile->interval_ms != 0 ? profile->interval_ms : s.interval_ms);
+  if (profile != nullptr) {
+    for (auto &s : profile->overrides)
+      apply(s, s.interval_ms);
+  }
+
+  uint32_t now = millis();
+  for (auto &cmd : poll_commands_) {
+    if (qpiri_event_driven_ && cmd.command == "QPIRI")
+      cmd.interval_ms = qpiri_safety_interval_ms_;  // остаётся только страховочный опрос
+    cmd.min_interval_ms = cmd.interval_ms;
+    cmd.stable_polls = 0;
+    // Новый срок — от последнего запуска с новым интервалом
+    cmd.next_due_ms = cmd.last_run_ms == 0 ? now : cmd.last_run_ms + cmd.interval_ms;
+  }
+
+  attach_poll_diagnostics_();
+  if (ready_)
+    rebuild_poll_heap_();
+}
+
+void SolarInverter::attach_poll_diagnostics_() {
+  for (auto &diag : poll_diagnostics_) {
+    auto it = std::find_if(poll_commands_.begin(), poll_commands_.end(),
+                           [&](const CommandEntry &e) { return e.command == diag.command; });
+    if (it == poll_commands_.end()) {
+      ESP_LOGW(TAG, "Діагностика для невідомої команди опитування %s", diag.command.c_str());
+      continue;
+    }
+    it->period_sensor = diag.period;
+    it->jitter_sensor = diag.jitter;
+    it->missed_sensor = diag.missed;
+  }
+}
+
+// Учёт запуска и перенос срока; вызывается для команды, уже снятой с кучи
+void SolarInverter::update_poll_stats_(CommandEntry &cmd, uint32_t now) {
+  uint32_t lateness = now - cmd.next_due_ms;
+
+  if (cmd.last_run_ms != 0) {
+    float period = now - cmd.last_run_ms;
+    float jitter = fabsf(period - cmd.interval_ms);
+    if (cmd.period_ms == 0) {
+      cmd.period_ms = period;
+      cmd.jitter_ms = jitter;
+    } else {
+      cmd.period_ms += POLL_STATS_ALPHA * (period - cmd.period_ms);
+      cmd.jitter_ms += POLL_STATS_ALPHA * (jitter - cmd.jitter_ms);
+    }
+    if (lateness >= cmd.interval_ms)
+      cmd.missed_count++;
+  }
+  cmd.last_run_ms = now;
+
+  // Сохраняем фазу, пока отставание меньше интервала; иначе — от текущего момента
+  if (lateness < cmd.interval_ms)
+    cmd.next_due_ms += cmd.interval_ms;
+  else
+    cmd.next_due_ms = now + cmd.interval_ms;
+}
+
+void SolarInverter::publish_poll_stats_() {
+  uint32_t now = millis();
+  if (poll_rate_sensor_ != nullptr && poll_rate_since_ms_ != 0 && now != poll_rate_since_ms_)
+    poll_rate_sensor_->publish_state(completed_polls_ * 1000.0f / (now - poll_rate_since_ms_));
+  completed_polls_ = 0;
+  poll_rate_since_ms_ = now;
+
+  for (auto &cmd : poll_commands_) {
+    if (cmd.period_sensor != nullptr && cmd.period_ms > 0)
+      cmd.period_sensor->publish_state(cmd.period_ms);
+    if (cmd.jitter_sensor != nullptr && cmd.period_ms > 0)
+      cmd.jitter_sensor->publish_state(cmd.jitter_ms);
+    if (cmd.missed_sensor != nullptr)
+      cmd.missed_sensor->publish_state(cmd.missed_count);
+  }
+
+  for (auto &diag : poll_diagnostics_) {
+    const ResponseTimeStats *stats = get_response_time_stats(diag.command);
+    if (stats == nullptr || stats->count == 0)
+      continue;
+    if (diag.response_time != nullptr)
+      diag.response_time->publish_state(stats->ewma_ms);
+    if (diag.response_timeout != nullptr)
+      diag.response_timeout->publish_state(stats->timeout_ms);
+  }
+}
+
+// ────────────────────────────────────────────────────────────────
+// Адаптивный опрос: растягиваем интервал неизменных ответов,
+// возвращаем к минимуму при изменении
+// ────────────────────────────────────────────────────────────────
+void SolarInverter::adapt_poll_interval_(const std::string &command, const InverterFrame &frame) {
+  auto it = std::find_if(poll_commands_.begin(), poll_commands_.end(),
+                         [&](const CommandEntry &e) { return e.command == command; });
+  if (it == poll_commands_.end())
+    return;
+  CommandEntry &cmd = *it;
+
+  bool changed;
+  if (command == "QPIGS") {
+    // Телеметрия шумит всегда — смотрим на скорость изменения мощности и напряжения
+    changed = qpigs_changed_fast_(frame, millis());
+  } else {
+    uint32_t hash = payload_hash_(frame.payload());
+    changed = hash != cmd.payload_hash;
+    cmd.payload_hash = hash;
+  }
+
+  if (changed) {
+    cmd.stable_polls = 0;
+    if (cmd.interval_ms != cmd.min_interval_ms) {
+      ESP_LOGD(TAG, "%s: інтервал %u -> %u мс", cmd.command.c_str(), cmd.interval_ms, cmd.min_interval_ms);
+      cmd.interval_ms = cmd.min_interval_ms;
+      // Срок уже мог быть отодвинут по старому интервалу — подтягиваем
+      uint32_t due = cmd.last_run_ms + cmd.interval_ms;
+      if (static_cast<int32_t>(cmd.next_due_ms - due) > 0) {
+        cmd.next_due_ms = due;
+        std::make_heap(poll_heap_.begin(), poll_heap_.end(),
+                       [this](uint8_t a, uint8_t b) { return poll_due_later_(a, b); });
+      }
+    }
+    return;
+  }
+
+  if (++cmd.stable_polls < adaptive_stable_polls_)
+    return;
+  cmd.stable_polls = 0;
+  uint32_t stretched = std::min<uint32_t>(cmd.interval_ms * 2, std::max(adaptive_max_interval_ms_, cmd.min_interval_ms));
+  if (stretched != cmd.interval_ms) {
+    ESP_LOGD(TAG, "%s: інтервал %u -> %u мс", cmd.command.c_str(), cmd.interval_ms, stretched);
+    cmd.interval_ms = stretched;
+  }
+}
+
+bool SolarInverter::qpigs_changed_fast_(const InverterFrame &frame, uint32_t now) {
+  float power, voltage;
+  if (!frame.field_float(5, power) || !frame.field_float(8, voltage))
+    return true;
+
+  bool fast = std::isnan(adaptive_last_power_) || adaptive_last_sample_ms_ == now;
+  if (!fast) {
+    float dt = (now - adaptive_last_sample_ms_) / 1000.0f;
+    fast = fabsf(power - adaptive_last_power_) / dt > adaptive_power_rate_ ||
+           fabsf(voltage - adaptive_last_voltage_) / dt > adaptive_voltage_rate_;
+  }
+  adaptive_last_power_ = power;
+  adaptive_last_voltage_ = voltage;
+  adaptive_last_sample_ms_ = now;
+  return fast;
+}
+
+// FNV-1a по полезной нагрузке ответа
+uint32_t SolarInverter::payload_hash_(std::string_view payload) {
+  uint32_t hash = 2166136261UL;
+  for (char c : payload) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
 void SolarInverter::send_command(const std::string &cmd) {
-  uint16_t crc = calculate_crc(cmd);
-  write_str(cmd.c_str());
-  write_byte((crc >> 8) & 0xFF);
-  write_byte(crc & 0xFF);
-  write_byte('\r');
+  // Кадры команд опроса готовы заранее, записи собираются здесь
+  const CommandFrame *frame = find_command_frame(cmd);
+  CommandFrame built;
+  if (frame == nullptr) {
+    built = make_command_frame(cmd);
+    frame = &built;
+  }
+  if (frame->len == 0) {
+    ESP_LOGE(TAG, "Команда задовга: %s", cmd.c_str());
+    return;
+  }
+  write_array(frame->bytes, frame->len);
   last_send_ = millis();
+  response_timeout_ms_ = response_timeout_for_(cmd);
   ESP_LOGD(TAG, "Відправлено команду: %s", cmd.c_str());
 }
 
+// ────────────────────────────────────────────────────────────────
+// Таймаут ответа по измеренному времени ответа:
+//   max(p90, EWMA + 4·отклонение) + передача четверти ответа + запас,
+//   не меньше времени передачи запроса и ответа на текущей скорости,
+//   не больше RESPONSE_TIMEOUT_MS; каждый таймаут подряд удваивает его
+// ────────────────────────────────────────────────────────────────
+uint32_t SolarInverter::frame_time_ms_(size_t bytes) const {
+  uint32_t baud = this->parent_ != nullptr ? this->parent_->get_baud_rate() : 0;
+  if (baud == 0)
+    baud = DEFAULT_BAUD_RATE;
+  return (bytes * 10 * 1000 + baud - 1) / baud;  // 8N1: 10 бит на байт
+}
+
+uint32_t SolarInverter::response_timeout_for_(const std::string &cmd) {
+  ResponseTimeStats &stats = response_times_[command_key_(cmd)];
+  // Запрос: команда + CRC + CR
+  uint32_t floor = std::max(RESPONSE_TIMEOUT_FLOOR_MS, frame_time_ms_(cmd.size() + 3 + stats.reply_bytes));
+
+  uint32_t timeout = RESPONSE_TIMEOUT_MS;
+  if (stats.count >= RESPONSE_TIME_MIN_SAMPLES) {
+    float base = std::max<float>(stats.p90_ms, stats.ewma_ms + 4 * stats.dev_ms);
+    timeout = static_cast<uint32_t>(base) + frame_time_ms_(stats.reply_bytes / 4) + RESPONSE_TIMEOUT_MARGIN_MS;
+    timeout <<= std::min<uint8_t>(stats.timeouts, 4);
+  }
+  stats.timeout_ms = std::min(std::max(timeout, floor), RESPONSE_TIMEOUT_MS);
+  return stats.timeout_ms;
+}
+
+void SolarInverter::record_response_time_(const std::string &cmd, uint32_t rtt_ms, size_t reply_bytes) {
+  ResponseTimeStats &stats = response_times_[command_key_(cmd)];
+  uint16_t sample = std::min<uint32_t>(rtt_ms, UINT16_MAX);
+  stats.timeouts = 0;
+  stats.reply_bytes = std::max<uint16_t>(stats.reply_bytes, std::min<size_t>(reply_bytes, UINT16_MAX));
+
+  if (stats.count == 0) {
+    stats.ewma_ms = sample;
+    stats.dev_ms = sample / 2.0f;
+  } else {
+    float err = sample - stats.ewma_ms;
+    stats.ewma_ms += RESPONSE_TIME_ALPHA * err;
+    stats.dev_ms += RESPONSE_TIME_BETA * (fabsf(err) - stats.dev_ms);
+  }
+
+  stats.window[stats.next] = sample;
+  stats.next = (stats.next + 1) % ResponseTimeStats::WINDOW;
+  if (stats.count < ResponseTimeStats::WINDOW)
+    stats.count++;
+
+  uint16_t sorted[ResponseTimeStats::WINDOW];
+  std::copy(stats.window, stats.window + stats.count, sorted);
+  std::sort(sorted, sorted + stats.count);
+  stats.p50_ms = sorted[stats.count / 2];
+  stats.p90_ms = sorted[(stats.count * 9 + 9) / 10 - 1];
+}
+
+const ResponseTimeStats *SolarInverter::get_response_time_stats(const std::string &cmd) const {
+  auto it = response_times_.find(command_key_(cmd));
+  return it != response_times_.end() ? &it->second : nullptr;
+}
+
+// ────────────────────────────────────────────────────────────────
+// Состояние связи: ONLINE → (таймауты подряд) DEGRADED → OFFLINE;
+// любой принятый кадр возвращает ONLINE
+// ────────────────────────────────────────────────────────────────
+void SolarInverter::set_link_state_(LinkState state) {
+  if (state == link_state_)
+    return;
+  ESP_LOGW(TAG, "Зв'язок з інвертором: %s -> %s", link_state_to_string(link_state_), link_state_to_string(state));
+  link_state_ = state;
+  link_state_since_ms_ = millis();
+  if (link_state_text_sensor_ != nullptr)
+    link_state_text_sensor_->publish_state(link_state_to_string(state));
+  publish_link_state_duration_();
+}
+
+void SolarInverter::publish_link_state_duration_() {
+  if (link_state_duration_sensor_ != nullptr)
+    link_state_duration_sensor_->publish_state((millis() - link_state_since_ms_) / 1000);
+}
+
+void SolarInverter::link_frame_received_() {
+  consecutive_timeouts_ = 0;
+  if (link_state_ == LINK_ONLINE)
+    return;
+  bool was_offline = link_state_ == LINK_OFFLINE;
+  set_link_state_(LINK_ONLINE);
+  if (!was_offline)
+    return;
+  // Полное расписание с нуля; настройки могли поменять с панели, пока связи не было
+  reset_poll_schedule_();
+#ifdef USE_SOLAR_INVERTER_QPIRI
+  send_priority_command("QPIRI");
+#endif
+}
+
+void SolarInverter::link_timeout_() {
+  if (consecutive_timeouts_ < UINT8_MAX)
+    consecutive_timeouts_++;
+
+  if (link_state_ == LINK_OFFLINE) {
+    probe_interval_ms_ = std::min(probe_interval_ms_ * 2, LINK_PROBE_MAX_MS);
+    ESP_LOGD(TAG, "Немає відповіді на %s, наступна спроба через %u мс", LINK_PROBE_COMMAND, probe_interval_ms_);
+    return;
+  }
+  if (consecutive_timeouts_ < LINK_OFFLINE_TIMEOUTS) {
+    if (consecutive_timeouts_ >= LINK_DEGRADED_TIMEOUTS)
+      set_link_state_(LINK_DEGRADED);
+    return;
+  }
+
+  set_link_state_(LINK_OFFLINE);
+  probe_interval_ms_ = LINK_PROBE_MIN_MS;
+  last_probe_ms_ = millis();
+  // Ждать в очереди без связи бессмысленно — отправители узнают сразу
+  while (!priority_commands_.empty()) {
+    CommandCallback callback = std::move(priority_commands_.front().callback);
+    priority_commands_.pop_front();
+    if (callback)
+      callback(COMMAND_DROPPED, {});
+  }
+}
+
 // ────────────────────────────────────────────────────────────────
 // Приём сырых ответов
 // ────────────────────────────────────────────────────────────────
-void SolarInverter::process_raw_response(const std::string &response) {
-  if (!check_crc(response)) {
-    ESP_LOGW(TAG, "CRC помилка для [%s]: %s", current_command_.c_str(), response.c_str());
+void SolarInverter::process_raw_response(const InverterFrame &frame) {
+  link_frame_received_();  // даже битый кадр значит, что инвертор на линии
+  if (state_ != WAITING_RESPONSE) {
+    ESP_LOGW(TAG, "Кадр без запиту відкинуто: %.*s", (int) frame.payload().size(), frame.payload().data());
+    return;
+  }
+
+  if (!frame.crc_ok) {
     std::string hex_string;
-    for (size_t i = 0; i < response.size(); i++) {
+    for (size_t i = 0; i < frame.len; i++) {
       char buf[4];
-      snprintf(buf, sizeof(buf), "%02X ", static_cast<uint8_t>(response[i]));
+      snprintf(buf, sizeof(buf), "%02X ", frame.raw[i]);
       hex_string += buf;
     }
+    ESP_LOGW(TAG, "CRC помилка для [%s]: %.*s", current_command_.c_str(), (int) frame.len,
+             reinterpret_cast<const char *>(frame.raw));
     ESP_LOGI(TAG, "Response HEX: %s", hex_string.c_str());
-    state_ = IDLE;
-    current_command_.clear();
+    finish_transaction_(COMMAND_CRC_ERROR, {});
     next_command_();
     return;
   }
 
-  std::string data = response.substr(1, response.length() - 4); // снять '(' и CRC+CR
+  std::string_view data = frame.payload();  // без '(' и CRC+CR
+  record_response_time_(current_command_, millis() - last_send_, frame.len);
+
+  // Запрос (Q…) получает данные, запись — только ACK/NAK. Ответ не того
+  // вида (запоздалый или чужой) закрывает транзакцию сразу, не дожидаясь
+  // таймаута, и не засчитывается отправителю как успех.
+  bool query = !current_command_.empty() && current_command_[0] == 'Q';
+  bool ack_nak = data == "ACK" || data == "NAK";
+  if (query == ack_nak) {
+    ESP_LOGW(TAG, "Неочікувана відповідь для команди [%s]: %.*s", current_command_.c_str(), (int) data.size(),
+             data.data());
+    finish_transaction_(COMMAND_UNEXPECTED, data);
+    next_command_();
+    return;
+  }
 
   if (data == "ACK") {
     ESP_LOGD(TAG, "Отримано ACK для команди [%s]", current_command_.c_str());
     ack_received_ = true;
-    state_ = IDLE;
-    current_command_.clear();
+    finish_transaction_(COMMAND_ACK, data);
     return;
   }
   if (data == "NAK") {
     ESP_LOGW(TAG, "Отримано NAK для команди [%s]", current_command_.c_str());
     ack_received_ = true;
-    state_ = IDLE;
-    current_command_.clear();
+    finish_transaction_(COMMAND_NAK, data);
     return;
   }
 
-  ESP_LOGD(TAG, "Отримано відповідь для команди [%s]: %s", current_command_.c_str(), data.c_str());
+  ESP_LOGD(TAG, "Отримано відповідь для команди [%s]: %.*s", current_command_.c_str(), (int) data.size(), data.data());
 
-  pending_results_.push({current_command_, data});
+  // Поля уже разбиты приёмником — разбираем сразу, без очереди и копий строк.
+  // В конвейерном режиме следующая команда уходит до разбора, и её ответ
+  // идёт по линии, пока мы публикуем этот.
+  std::string command = current_command_;
+  finish_transaction_(COMMAND_RESPONSE, data);
+  if (adaptive_polling_)
+    adapt_poll_interval_(command, frame);
+  process_result(command, frame);
+}
+
+// Транзакция завершена: сообщаем итог отправителю и освобождаем линию
+void SolarInverter::finish_transaction_(CommandResult result, std::string_view payload) {
+  CommandCallback callback = std::move(current_callback_);
+  current_callback_ = nullptr;
   state_ = IDLE;
   current_command_.clear();
+  if (callback)
+    callback(result, payload);
+
+  if (result != COMMAND_RESPONSE && result != COMMAND_ACK && result != COMMAND_NAK)
+    return;
+  completed_polls_++;
+  if (pipelined_ && ready_)
+    next_command_();
 }
 
 
 // ────────────────────────────────────────────────────────────────
-// process_result: только сохраняет полезные payload‑ы
+// process_result: сохраняет кадры для пошаговой публикации,
+// короткие ответы разбирает сразу
 // ────────────────────────────────────────────────────────────────
-void SolarInverter::process_result(const std::string &command, const std::string &payload) {
-  if (command == "QPIGS") {
-    last_qpigs_data_ = payload;
-    qpigs_publish_index_ = 0;
-    qpigs_ready_ = true;
-  } else if (command == "QBEQI") {
-    last_qbeqi_data_ = payload;
-    qbeqi_publish_index_ = 0;
-    qbeqi_ready_ = true;
-  } else if (command == "QPIRI") {
-    last_qpiri_data_ = payload;
-    qpiri_publish_index_ = 0;
-    qpiri_ready_ = true;
-  } else if (command == "QMOD") {
-    this->process_qmod_(payload); 
-  } else if (command == "QFLAG") {
-    this->process_qflag_(payload);
-  } else if (command == "QPIWS") {
-    if (this->warning_status_text_sensor_)
-      this->warning_status_text_sensor_->publish_state(decode_qpiws_(payload));
-  }else if (command == "QPI") {
-    if (protocol_id_sensor_) protocol_id_sensor_->publish_state(payload);
+void SolarInverter::process_result(const std::string &command, const InverterFrame &frame) {
+  for (size_t i = 0; i < RESPONSE_COUNT; i++) {
+    if (command != RESPONSES[i].command)
+      continue;
+    if (frame.field_count < RESPONSES[i].min_fields) {
+      ESP_LOGW(TAG, "Короткий кадр %s: %u полів", command.c_str(), frame.field_count);
+      return;
+    }
+    // Новый снимок заменяет прежний целиком; недопубликованный прежний
+    // не смешивается с ним — публикация начинается заново
+    DecodeSource &source = decode_sources_[i];
+    build_snapshot(RESPONSES[i], frame, source.snapshot.sequence + 1, millis(), source.snapshot);
+    source.next_field = 0;
+    source.ready = true;
+    return;
+  }
+
+#ifdef USE_SOLAR_INVERTER_QMOD
+  if (command == "QMOD") {
+    this->process_qmod_(std::string(frame.payload()));
+    return;
+  }
+#endif
+#ifdef USE_SOLAR_INVERTER_QFLAG
+  if (command == "QFLAG") {
+    this->process_qflag_(frame.payload());
+    return;
+  }
+#endif
+#ifdef USE_SOLAR_INVERTER_QPIWS
+  if (command == "QPIWS") {
+    this->process_qpiws_(frame.payload());
+    return;
+  }
+#endif
+  if (command == "QPI") {
+    if (protocol_id_sensor_) protocol_id_sensor_->publish_state(std::string(frame.payload()));
   } else if (command == "QID") {
-    if (serial_number_sensor_) serial_number_sensor_->publish_state(payload);
+    if (serial_number_sensor_) serial_number_sensor_->publish_state(std::string(frame.payload()));
   } else {
-    ESP_LOGD(TAG, "Невідома відповідь [%s]: %s", command.c_str(), payload.c_str());
+    std::string_view payload = frame.payload();
+    ESP_LOGD(TAG, "Невідома відповідь [%s]: %.*s", command.c_str(), (int) payload.size(), payload.data());
   }
 }
 
 // ────────────────────────────────────────────────────────────────
-// Публикация QPIGS по частям (не >1 сенсор за цикл)
+// Публикация ответов по таблицам: поля публикуются по очереди
+// из всех источников (по одному полю на источник за круг), пока
+// не исчерпан бюджет publish_budget_us_. Одно поле за loop()
+// публикуется всегда, даже если бюджет меньше его стоимости.
 // ────────────────────────────────────────────────────────────────
-void SolarInverter::publish_next_qpigs_chunk_() {
-  if (!qpigs_ready_) return;
+void SolarInverter::publish_pending_fields_() {
+  uint32_t start = micros();
+  uint8_t idle = 0;  // источников подряд без данных
+  while (idle < RESPONSE_COUNT) {
+    uint8_t i = publish_cursor_;
+    publish_cursor_ = (publish_cursor_ + 1) % RESPONSE_COUNT;
+    DecodeSource &source = decode_sources_[i];
+    if (!source.ready || !publish_next_field_(RESPONSES[i], source)) {
+      idle++;
+      continue;
+    }
+    idle = 0;
+    if (micros() - start >= publish_budget_us_)
+      break;
+  }
+}
 
-  static std::vector<std::string> parts;
-  if (qpigs_publish_index_ == 0) {
-    parts = split_string(last_qpigs_data_, ' ');
-    if (parts.size() < 21) {
-      qpigs_ready_ = false;
-      return;
+// Политика публикации: heartbeat публикует всегда, min_interval — никогда,
+// в остальное время — только выход за мёртвую зону
+bool SolarInverter::should_publish_(EntitySlot slot, float value) {
+  uint8_t index = publish_policy_index_[slot];
+  if (index == 0)
+    return true;
+  PublishPolicy &policy = publish_policies_[index - 1];
+  uint32_t now = millis();
+  uint32_t since = now - policy.last_publish_ms;
+
+  if (!std::isnan(policy.last_value)) {
+    if (since < policy.min_interval_ms)
+      return false;
+    bool heartbeat = policy.heartbeat_ms != 0 && since >= policy.heartbeat_ms;
+    if (!heartbeat) {
+      float delta = fabsf(value - policy.last_value);
+      float band = std::max(policy.deadband, policy.deadband_percent * fabsf(policy.last_value));
+      if (band > 0 ? delta < band : delta == 0)
+        return false;
     }
   }
+  policy.last_value = value;
+  policy.last_publish_ms = now;
+  return true;
+}
 
-  auto publish = [&](sensor::Sensor *s, int idx) {
-    float v;
-    if (idx < parts.size() && safe_stof(parts[idx], v) && s)
-      s->publish_state(v);
-  };
+const ResponseSnapshot *SolarInverter::get_snapshot(const std::string &command) const {
+  for (size_t i = 0; i < RESPONSE_COUNT; i++) {
+    if (command == RESPONSES[i].command)
+      return &decode_sources_[i].snapshot;
+  }
+  return nullptr;
+}
 
-  switch (qpigs_publish_index_) {
-    case 0:  publish(grid_voltage_sensor_, 0); break;
-    case 1:  publish(grid_freq_sensor_, 1); break;
-    case 2:  publish(ac_output_voltage_sensor_, 2); break;
-    case 3:  publish(ac_output_freq_sensor_, 3); break;
-    case 4:  publish(output_apparent_power_sensor_, 4); break;
-    case 5:  publish(output_active_power_sensor_, 5); break;
-    case 6:  publish(output_load_percent_sensor_, 6); break;
-    case 7:  publish(bus_voltage_sensor_, 7); break;
-    case 8:  publish(battery_voltage_sensor_, 8); break;
-    case 9:  publish(battery_charging_current_sensor_, 9); break;
-    case 10: publish(battery_capacity_sensor_, 10); break;
-    case 11: publish(inverter_temp_sensor_, 11); break;
-    case 12: publish(pv_input_current_sensor_, 12); break;
-    case 13: publish(pv_input_voltage_sensor_, 13); break;
-    case 14: publish(battery_voltage_from_scc_sensor_, 14); break;
-    case 15: publish(battery_discharge_current_sensor_, 15); break;
-    case 16: process_qpigs_status_bits_(parts[16]); break;
-    case 17: {
-      float v; if (safe_stof(parts[17], v) && fan_on_voltage_offset_sensor_) fan_on_voltage_offset_sensor_->publish_state(v*0.01f);
-      break;
-    }
-    case 18: if (eeprom_version_text_) eeprom_version_text_->publish_state(parts[18]); break;
-    case 19: publish(pv_charging_power_sensor_, 19); break;
-    case 20: process_qpigs_flag_bits_(parts[20]); break;
+// Публикует одно поле с сущностью; false — в кадре их больше нет
+bool SolarInverter::publish_next_field_(const ResponseDescriptor &response, DecodeSource &source) {
+  bool published = false;
+  while (!published && source.next_field < response.field_count) {
+    size_t row = source.next_field++;
+    const FieldDescriptor &desc = response.fields[row];
+    bool handler = desc.type == FIELD_STATUS_BITS || desc.type == FIELD_FLAG_BITS;
+    if (!handler && field_entities_[desc.slot] == nullptr)
+      continue;  // поле не настроено
+    DecodedField field;
+    if (source.snapshot.field(row, field))
+      apply_field_(desc, field);
+    published = true;
   }
+  if (source.next_field >= response.field_count) {
+    source.ready = false;
+    source.next_field = 0;
+  }
+  return published;
+}
 
-  qpigs_publish_index_++;
-  if (qpigs_publish_index_ >= 21) {
-    qpigs_ready_ = false;
-    qpigs_publish_index_ = 0;
+void SolarInverter::apply_field_(const FieldDescriptor &desc, const DecodedField &field) {
+  EntityBase *entity = field_entities_[desc.slot];
+  switch (desc.type) {
+    case FIELD_SENSOR:
+      if (should_publish_(desc.slot, field.value))
+        static_cast<sensor::Sensor *>(entity)->publish_state(field.value);
+      break;
+    case FIELD_NUMBER:
+      static_cast<InverterNumber *>(entity)->set_state_from_inverter(field.value);
+      break;
+    case FIELD_SELECT:
+      static_cast<InverterSelect *>(entity)->update_state_from_inverter(std::string(field.text));
+      break;
+    case FIELD_TEXT:
+      static_cast<text_sensor::TextSensor *>(entity)->publish_state(std::string(field.text));
+      break;
+    case FIELD_STATUS_BITS:
+      process_qpigs_status_bits_(field.text);
+      break;
+    case FIELD_FLAG_BITS:
+      process_qpigs_flag_bits_(field.text);
+      break;
   }
 }
 
 // ────────────────────────────────────────────────────────────────
 // Разбор bits b7..b0 (index 16)
 // ────────────────────────────────────────────────────────────────
-void SolarInverter::process_qpigs_status_bits_(const std::string &bits) {
+void SolarInverter::process_qpigs_status_bits_(std::string_view bits) {
   if (bits.length() != 8) return;  // ожидаем 8 символов 0/1
   auto b = [&](int i) { return bits[7 - i] == '1'; }; // b0 = bits[7]
 
+  // b6 «конфигурация изменена» — повод перечитать QPIRI
+  int8_t config_changed = b(6);
+  if (last_config_changed_ >= 0 && config_changed != last_config_changed_)
+    request_qpiri_refresh();
+  last_config_changed_ = config_changed;
+
   if (pv_or_ac_powering_load_) pv_or_ac_powering_load_->publish_state(b(7));
   if (config_changed_)         config_changed_->publish_state(b(6));
   if (scc_fw_updated_)         scc_fw_updated_->publish_state(b(5));
@@ -466,7 +1231,7 @@ void SolarInverter::process_qpigs_status_bits_(const std::string &bits) {
 // ────────────────────────────────────────────────────────────────
 // Разбор bits b10..b8 (index 20)
 // ────────────────────────────────────────────────────────────────
-void SolarInverter::process_qpigs_flag_bits_(const std::string &bits) {
+void SolarInverter::process_qpigs_flag_bits_(std::string_view bits) {
   // строка может быть, например, "110" или "001" — 3 бита
   if (bits.length() != 3) return;
   bool b10 = bits[0]=='1';
@@ -477,150 +1242,7 @@ void SolarInverter::process_qpigs_flag_bits_(const std::string &bits) {
   if (dustproof_installed_)   dustproof_installed_->publish_state(b8);
 }
 
-// ────────────────────────────────────────────────────────────────
-// Публикация QBEQI по частям (не >1 сенсор за цикл)
-// ────────────────────────────────────────────────────────────────
-void SolarInverter::publish_next_qbeqi_chunk_() {
-  static std::vector<std::string> parts;
-  static size_t count = 0;
-  if (qbeqi_publish_index_ == 0) {
-    parts = split_string(last_qbeqi_data_, ' ');
-    count = parts.size();
-//    if (parts.size() < 10) {
-//      qbeqi_ready_ = false;
-//      return;
-//    }
-  }
-  auto to_int = [](const std::string &s) -> int {
-    return std::stoi(s);
-  };
-
-    auto to_float = [](const std::string &s) -> float {
-    return std::stof(s);
-  };
-
-  switch (qbeqi_publish_index_) {
-    case 0:
-      if (equalization_enable_)
-        equalization_enable_->update_state_from_inverter(parts[0]);
-      break;
-    case 1:
-      if (equalization_time_)
-        equalization_time_->publish_state(to_int(parts[1]));
-      break;
-    case 2:
-      if (equalization_period_)
-        equalization_period_->publish_state(to_int(parts[2]));
-      break;
-    case 3:
-      if (equalization_max_current_)
-        equalization_max_current_->publish_state(to_int(parts[3]));
-      break;
-    case 5:
-      if (equalization_voltage_)
-        equalization_voltage_->publish_state(to_float(parts[5]));
-      break;
-    case 7:
-      if (equalization_over_time_)
-        equalization_over_time_->publish_state(to_int(parts[7]));
-      break;
-    case 8:
-      if (equalization_active_)
-        equalization_active_->update_state_from_inverter(parts[8]);
-      break;
-    case 9:
-      if (equalization_elapsed_time_)
-        equalization_elapsed_time_->publish_state(to_int(parts[9]));
-      break;
-  }
-
-  qbeqi_publish_index_++;
-  if (qbeqi_publish_index_ >= count) {
-    qbeqi_ready_ = false;
-    qbeqi_publish_index_ = 0;
-  }
-}
-
-// ────────────────────────────────────────────────────────────────
-// Публикация QPIRI по частям (не >1 сенсор за цикл)
-// ────────────────────────────────────────────────────────────────
-void SolarInverter::publish_sensor(sensor::Sensor *sensor, int index) {
-  if (sensor != nullptr && index < this->qpiri_parts_.size()) {
-    float v;
-    if (safe_stof(this->qpiri_parts_[index], v)) {
-      sensor->publish_state(v);
-    }
-  }
-}
-
-void SolarInverter::publish_number(InverterNumber *number, int index) {
-  if (number != nullptr && index < this->qpiri_parts_.size()) {
-    float v;
-    if (!safe_stof(this->qpiri_parts_[index], v)) {return;}
-    ESP_LOGD(TAG, "Publishing number: index=%d value=%.2f", index, v);
-    number->publish_state(v);
-  }
-}
-
-void SolarInverter::publish_select(InverterSelect *sel, int index) {
-  if (sel != nullptr && index < this->qpiri_parts_.size()) {
-    sel->update_state_from_inverter(this->qpiri_parts_[index]);
-  }
-}
-
-
-void SolarInverter::publish_next_qpiri_chunk_() {
-  if (!qpiri_ready_) return;
-
-  if (qpiri_publish_index_ == 0) {
-    this->qpiri_parts_ = split_string(last_qpiri_data_, ' ');
-    // Можешь вернуть эту проверку при необходимости:
-    // if (qpiri_parts_.size() < 28) {
-    //   qpiri_ready_ = false;
-    //   return;
-    // }
-  }
-
-  switch (qpiri_publish_index_) {
-    case 0:  publish_sensor(grid_rating_voltage_, 0); break;           // BBB.B  Grid rating voltage V
-    case 1:  publish_sensor(grid_rating_current_, 1); break;           // CC.C   Grid rating current A
-    case 2:  publish_number(ac_output_rating_voltage_, 2); break;      // DDD.D  (10) AC output rating voltage V
-    case 3:  publish_number(ac_output_rating_frequency_, 3); break;    // EE.E   (09) AC output rating frequency Hz
-    case 4:  publish_number(ac_output_rating_current_, 4); break;      // FF.F   AC output rating current A
-    case 5:  publish_number(ac_output_apparent_power_, 5); break;      // HHHH   AC output rating apparent power VA
-    case 6:  publish_number(ac_output_active_power_, 6); break;        // IIII   AC output rating active power W
-    case 7:  publish_number(battery_rating_voltage_, 7); break;        // JJ.J   Battery rating voltage V
-    case 8:  publish_number(battery_recharge_voltage_, 8); break;      // KK.K   (12) Battery re-charge voltage V
-    case 9:  publish_number(battery_undervoltage_, 9); break;          // JJ.J   (29) Battery under voltage V
-    case 10: publish_number(battery_bulk_voltage_, 10); break;         // KK.K   (26) Battery bulk voltage V
-    case 11: publish_number(battery_float_voltage_, 11); break;        // LL.L   (27) Battery float voltage V
-    case 12: publish_select(battery_type_, 12); break;                 // O      (05) Battery type 0: AGM 1: Flooded 2: User 3: LIB 4: LIC 5: LIP 6: LIL
-    case 13: publish_number(max_ac_charging_current_, 13); break;      // PPP    (11) Current max AC charging current
-    case 14: publish_number(max_charging_current_, 14); break;         // QQ0    (02) Current max charging current
-    case 15: publish_select(input_voltage_range_, 15); break;          // O      (03) Input voltage range 0: Appliance  1: UPS
-    case 16: publish_select(output_source_priority_, 16); break;       // P      (01) Output source priority 0: UtilitySolarBat 1: SolarUtilityBat 2: SolarBatUtility 3:SolarBatUtility*
-    case 17: publish_select(charger_source_priority_, 17); break;      // Q      (16) Charger source priority 1: Solar + Utility (SNU) 2: Only Solar (OSO) 3|0: Solar first (CSO)
-    case 18: publish_sensor(parallel_max_number_, 18); break;          // R      Parallel max number 
-    case 19: publish_select(machine_type_, 19); break;                 // SS     Machine type 00: Grid tie; 01: Off Grid; 10: Hybrid
-    case 20: publish_select(topology_, 20); break;                     // T      Topology 0: transformerless 1: transformer
-    case 21: publish_select(output_mode_, 21); break;                  // U      Output mode 
-    case 22: publish_number(battery_redischarge_voltage_, 22); break;  // VV.V   (13) Battery re-discharge voltage
-    case 23: publish_select(pv_ok_condition_, 23); break;              // W      PV OK condition for parallel
-    case 24: publish_select(pv_power_balance_, 24); break;             // X      PV power balance 
-    case 25: publish_sensor(neizvestno_, 25); break;                   // X.XX   ()
-    case 26: publish_number(grid_tie_current_, 26); break;             // YY     (38) GRID-tie current
-    case 27: publish_number(operation_logic_, 27); break;              // Zz.z   ()
-  }
-  
-
-  qpiri_publish_index_++;
-  if (qpiri_publish_index_ >= qpiri_parts_.size()) {
-    qpiri_ready_ = false;
-    qpiri_publish_index_ = 0;
-  }
-}
-
-
+#ifdef USE_SOLAR_INVERTER_QMOD
 // ────────────────────────────────────────────────────────────────
 // Разбор  QMOD<cr>: Device Mode inquiry 
 // ────────────────────────────────────────────────────────────────
@@ -644,40 +1266,73 @@ void SolarInverter::process_qmod_(const std::string &payload) {
   }
 }
 
+#endif  // USE_SOLAR_INVERTER_QMOD
+
+#ifdef USE_SOLAR_INVERTER_QFLAG
 // ────────────────────────────────────────────────────────────────
-// Разбор  QFLAG<cr>: Device Mode inquiry 
+// Разбор  QFLAG<cr>: "(EakxyzDbjuvw" -> маска включённых флагов a..z.
+// Переключатели обновляются только по изменившимся битам (и те, у
+// которых идёт запись — им нужно подтверждение чтением).
 // ────────────────────────────────────────────────────────────────
-void SolarInverter::process_qflag_(const std::string &payload) {
+void SolarInverter::process_qflag_(std::string_view payload) {
   if (payload.empty()) {
     ESP_LOGW(TAG, "Empty QFLAG payload");
     return;
   }
 
-  std::set<char> enabled_flags;
-  std::set<char> disabled_flags;
-
-  size_t pos = 0;
-  while (pos < payload.size()) {
-    char state = payload[pos];  // 'E' или 'D'
-    ++pos;
-    // Читаем все символы пока не встретится 'E' или 'D' или конец строки
-    std::string flags;
-    while (pos < payload.size() && payload[pos] != 'E' && payload[pos] != 'D') {
-      flags += payload[pos];
-      ++pos;
+  uint32_t enabled = 0;
+  uint32_t reported = 0;
+  bool state_enabled = false;
+  bool has_state = false;
+  for (char c : payload) {
+    if (c == 'E' || c == 'D') {
+      state_enabled = c == 'E';
+      has_state = true;
+    } else if (c >= 'a' && c <= 'z' && has_state) {
+      uint32_t bit = qflag_bit(c);
+      reported |= bit;
+      if (state_enabled)
+        enabled |= bit;
+    } else {
+      ESP_LOGW(TAG, "Unknown char in QFLAG: %c", c);
     }
+  }
 
-    if (state == 'E') {
-      enabled_flags.insert(flags.begin(), flags.end());
-    } else if (state == 'D') {
-      disabled_flags.insert(flags.begin(), flags.end());
-    } else {
-      ESP_LOGW(TAG, "Unknown state char in QFLAG: %c", state);
+  uint32_t unknown = reported & ~QFLAG_KNOWN_MASK;
+  if (unknown != qflag_unknown_mask_ || !qflag_mask_valid_) {
+    qflag_unknown_mask_ = unknown;
+    if (qflag_unknown_flags_sensor_ != nullptr) {
+      char letters[QFLAG_FLAG_COUNT + 1];
+      size_t n = 0;
+      for (uint8_t i = 0; i < QFLAG_FLAG_COUNT; i++) {
+        if (unknown & (uint32_t(1) << i))
+          letters[n++] = 'a' + i;
+      }
+      letters[n] = '\0';
+      qflag_unknown_flags_sensor_->publish_state(letters);
     }
   }
 
-  // Инициализация карты (пример)
-  std::map<char, InverterSwitch*> flag_map = {
+  uint32_t changed = qflag_mask_valid_ ? enabled ^ qflag_enabled_mask_ : QFLAG_ALL_MASK;
+  qflag_enabled_mask_ = enabled;
+  qflag_mask_valid_ = true;
+
+  for (uint8_t i = 0; i < QFLAG_FLAG_COUNT; i++) {
+    InverterSwitch *sw = qflag_switches_[i];
+    if (sw == nullptr)
+      continue;
+    uint32_t bit = uint32_t(1) << i;
+    if (!(changed & bit) && !sw->write_in_flight())
+      continue;
+    bool on = enabled & bit;
+    sw->update_state_from_inverter(on);  // обновляем состояние без вызова callback
+    ESP_LOGD(TAG, "QFLAG: %c = %s", 'a' + i, on ? "ON" : "OFF");
+  }
+}
+
+void SolarInverter::setup_qflag_switches() {
+  // Флаг -> переключатель
+  const std::pair<char, InverterSwitch *> switches[] = {
     {'a', buzzer_control_},
     {'b', overload_bypass_},
     {'k', display_escape_to_default_page_},
@@ -689,41 +1344,17 @@ void SolarInverter::process_qflag_(const std::string &payload) {
     {'w', power_saving_},
     {'m', data_log_popup_},
     {'d', solar_feed_to_grid_},
-    {'g', grid_charge_enable_}
+    {'g', grid_charge_enable_},
   };
 
-  // Обработка пришедших флагов
-  for (const auto &pair : flag_map) {
-    if (pair.second != nullptr) {
-      bool enabled = enabled_flags.count(pair.first) > 0;
-      pair.second->update_state_from_inverter(enabled);  // обновляем состояние без вызова callback
-
-      ESP_LOGD(TAG, "QFLAG: %c = %s", pair.first, enabled ? "ON" : "OFF");
-    }
-  }
-}
-
-void SolarInverter::setup_qflag_switches() {
-  // Инициализация карты флагов -> переключателей
-  qflag_switches_['a'] = buzzer_control_;
-  qflag_switches_['b'] = overload_bypass_;
-  qflag_switches_['k'] = display_escape_to_default_page_;
-  qflag_switches_['u'] = overload_restart_;
-  qflag_switches_['v'] = over_temperature_restart_;
-  qflag_switches_['x'] = backlight_control_;
-  qflag_switches_['y'] = alarm_primary_source_interrupt_;
-  qflag_switches_['z'] = fault_code_record_;
-  qflag_switches_['w'] = power_saving_;
-  qflag_switches_['m'] = data_log_popup_;
-  qflag_switches_['d'] = solar_feed_to_grid_;
-  qflag_switches_['g'] = grid_charge_enable_;
-
-  for (auto &pair : qflag_switches_) {
+  for (const auto &pair : switches) {
     if (pair.second != nullptr) {
       char flag = pair.first;
       auto *sw = pair.second;
+      qflag_switches_[flag - 'a'] = sw;
 
       // Подписка на изменение состояния свитча
+      sw->set_readback_command("QFLAG");
       sw->add_on_state_callback([this, flag, sw](bool state) {
         // Отправляем команду ТОЛЬКО если изменение пришло от пользователя,
         // а не из обновления состояния из инвертора
@@ -734,8 +1365,8 @@ void SolarInverter::setup_qflag_switches() {
           cmd = (state ? "PE" : "PD");
           cmd += flag;
 
-          send_priority_command(cmd);
-          send_priority_command("QFLAG");
+          sw->set_write_target(state);
+          begin_write(sw, cmd);
           ESP_LOGD(TAG, "Sent command for flag %c: %s", flag, cmd.c_str());
         }
       });
@@ -743,109 +1374,78 @@ void SolarInverter::setup_qflag_switches() {
   }
 }
 
-std::string SolarInverter::decode_qpiws_(const std::string &bits) {
-  static const char* warning_messages[36] = {
-    "Inverter fault / Overcharge current",      // 0 = a0
-    "Battery over-temperature",                 // 1
-    "Battery under-voltage",                    // 2
-    "Battery over-voltage",                     // 3
-    "PV input over-voltage",                    // 4
-    "Battery temp too low",                     // 5
-    "Battery temp too high",                    // 6
-    "Reserved", "Reserved", "Reserved", "Reserved", "Reserved", "Reserved", "Reserved", "Reserved", "Reserved",
-    "Reserved", "Reserved", "Reserved", "Reserved",                       // 7..19
-    "PV low loss warning",                      // 20
-    "PV derating (high PV)",                    // 21
-    "Derating (high temp)",                     // 22
-    "Battery temperature low warning",          // 23
-    "Battery disconnect",                       // 24
-    "Reserved", "Reserved", "Reserved", "Reserved", "Reserved",          // 25..29
-    "Battery low warning",                      // 30
-    "Load short circuit fault",                 // 31
-    "DSP communication fault"                   // 32
-    // Bits 33, 34, 35 — можно также добавить при необходимости
-  };
+#endif  // USE_SOLAR_INVERTER_QFLAG
 
-  std::vector<std::string> active_warnings;
-  for (size_t i = 0; i < bits.size() && i < 36; ++i) {
-    if (bits[i] == '1') {
-      active_warnings.push_back(warning_messages[i]);
+#ifdef USE_SOLAR_INVERTER_QPIWS
+// ────────────────────────────────────────────────────────────────
+// QPIWS: маска предупреждений; сущности и история меняются только
+// на изменившихся битах
+// ────────────────────────────────────────────────────────────────
+void SolarInverter::process_qpiws_(std::string_view bits) {
+  uint64_t mask;
+  if (!parse_warning_mask(bits, mask)) {
+    ESP_LOGW(TAG, "Некоректна відповідь QPIWS: %.*s", (int) bits.size(), bits.data());
+    return;
+  }
+  bool first = !warning_mask_valid_;
+  uint64_t changed = first ? ~uint64_t(0) : mask ^ warning_mask_;
+  if (changed == 0)
+    return;
+  warning_mask_ = mask;
+  warning_mask_valid_ = true;
+
+  uint32_t now = millis();
+  for (size_t row = 0; row < WARNING_COUNT; row++) {
+    const WarningDescriptor &warning = QPIWS_WARNINGS[row];
+    uint64_t bit = uint64_t(1) << warning.bit;
+    if (!(changed & bit))
+      continue;
+    bool active = mask & bit;
+    WarningStats &stats = warning_stats_[row];
+    if (active) {
+      if (stats.occurrences == 0)
+        stats.first_seen_ms = now;
+      stats.last_seen_ms = now;
+      stats.occurrences++;
+      ESP_LOGW(TAG, "Попередження: %s", warning.message);
+    } else if (!first) {
+      stats.last_cleared_ms = now;
+      ESP_LOGI(TAG, "Попередження зникло: %s", warning.message);
     }
+    if (warning_binary_sensors_[row] != nullptr)
+      warning_binary_sensors_[row]->publish_state(active);
   }
 
-  if (active_warnings.empty())
-    return "No warnings";
+  if (warning_status_text_sensor_ != nullptr)
+    warning_status_text_sensor_->publish_state(warning_text_(mask));
+}
 
+std::string SolarInverter::warning_text_(uint64_t mask) {
+  if (mask == 0)
+    return "No warnings";
   std::string result;
-  for (const auto &msg : active_warnings) {
+  for (uint8_t bit = 0; bit < 64; bit++) {
+    if (!(mask & (uint64_t(1) << bit)))
+      continue;
     if (!result.empty())
       result += ", ";
-    result += msg;
+    size_t row = warning_row(bit);
+    if (row < WARNING_COUNT) {
+      result += QPIWS_WARNINGS[row].message;
+    } else {
+      char buf[24];
+      snprintf(buf, sizeof(buf), "Reserved (bit %u)", bit);
+      result += buf;
+    }
   }
   return result;
 }
 
+#endif  // USE_SOLAR_INVERTER_QPIWS
+
 // ────────────────────────────────────────────────────────────────
-// CRC utils & helpers                                            
+// Helpers
 // ────────────────────────────────────────────────────────────────
-uint16_t SolarInverter::calculate_crc(const std::string &cmd) {
-  return cal_crc_half(reinterpret_cast<const uint8_t *>(cmd.data()), cmd.length());
-}
-
-uint16_t SolarInverter::cal_crc_half(const uint8_t* data, size_t len) {
-  static const uint16_t crc_ta[16] = {
-      0x0000,0x1021,0x2042,0x3063,0x4084,0x50a5,0x60c6,0x70e7,
-      0x8108,0x9129,0xa14a,0xb16b,0xc18c,0xd1ad,0xe1ce,0xf1ef
-  };
-  uint16_t crc = 0;
-  size_t pos = 0;
-  if (len == 0) return 0;
-  while (len-- != 0) {
-      uint8_t da = (crc >> 12) & 0x0F;
-      crc <<= 4;
-      crc ^= crc_ta[da ^ (data[pos] >> 4)];
-      da = (crc >> 12) & 0x0F;
-      crc <<= 4;
-      crc ^= crc_ta[da ^ (data[pos] & 0x0F)];
-      pos++;
-  }
-  uint8_t bCRCLow = crc & 0xFF;
-  uint8_t bCRCHigh = (crc >> 8) & 0xFF;
-  if (bCRCLow == 0x28 || bCRCLow == 0x0d || bCRCLow == 0x0a) bCRCLow++;
-  if (bCRCHigh == 0x28 || bCRCHigh == 0x0d || bCRCHigh == 0x0a) bCRCHigh++;
-  crc = (bCRCHigh << 8) | bCRCLow;
-  return crc;
-}
-
-bool SolarInverter::check_crc(const std::string &response) {
-  if (response.size() < 3) return false;
-  const uint8_t *data = reinterpret_cast<const uint8_t *>(response.data());
-  uint16_t received = (data[response.size()-3] << 8) | data[response.size()-2];
-  uint16_t calc = cal_crc_half(data, response.size()-3);
-  return received == calc;
-}
-
-std::vector<std::string> SolarInverter::split_string(const std::string &s, char delimiter) {
-  std::vector<std::string> out; std::string tmp; std::istringstream ss(s);
-  while (std::getline(ss, tmp, delimiter)) out.push_back(tmp);
-  return out;
-}
-
-bool SolarInverter::safe_stof(const std::string &s, float &v) {
-  if (s.empty()) return false;
-  char *end = nullptr;
-  v = strtof(s.c_str(), &end);
-  return end != s.c_str() && *end == '\0';
-}
-
-void SolarInverter::set_flag(char flag, bool enabled) {
-  std::string cmd = (enabled ? "PE" : "PD");
-  cmd += flag;
-  send_command(cmd);
-}
-
-
-
 void SolarInverter::add_inverter_select(int index, InverterSelect *sel) {
 //  this->inverter_selects_by_index_[index] = sel;  // сохраняем по индексу
 
@@ -854,13 +1454,14 @@ void SolarInverter::add_inverter_select(int index, InverterSelect *sel) {
   const auto &options = sel->get_options_list();
   const std::string &field_name = sel->get_field_name();
 
-  sel->set_on_user_select_callback([this, prefix, params, options, field_name](const std::string &value) {
+  sel->set_on_user_select_callback([this, sel, prefix, params, options, field_name](const std::string &value) {
     auto it = std::find(options.begin(), options.end(), value);
     if (it != options.end()) {
       int idx = std::distance(options.begin(), it);
       if (idx >= 0 && idx < static_cast<int>(params.size())) {
         std::string command = prefix + params[idx];
-        this->send_command(command);
+        sel->set_write_target(params[idx]);
+        this->begin_write(sel, command);
         ESP_LOGD(TAG, "Select '%s': '%s' -> '%s'", field_name.c_str(), value.c_str(), command.c_str());
       } else {
         ESP_LOGW(TAG, "Index %d out of range for select '%s'", idx, field_name.c_str());
@@ -871,6 +1472,11 @@ void SolarInverter::add_inverter_select(int index, InverterSelect *sel) {
   });
 }
 
+// Состояние публикует сам set_poll_profile(); неизвестный профиль не меняет выбор
+void PollProfileSelect::control(const std::string &value) {
+  if (this->parent_ != nullptr)
+    this->parent_->set_poll_profile(value);
+}
 
 }  // namespace solar_inverter
 }  // namespace esphome
\ No newline at end of file
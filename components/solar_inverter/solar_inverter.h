@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "esphome/core/defines.h"
 #include "esphome/core/log.h"
 #include "esphome/core/component.h"
 #include "esphome/components/uart/uart.h"
@@ -15,10 +16,18 @@
 #include "inverter_switch.h"
 #include "inverter_select.h"
 #include "inverter_number.h"
+#include "inverter_frame.h"
+#include "inverter_decoder.h"
+#include "inverter_energy.h"
+#include "inverter_history.h"
+#ifdef USE_SOLAR_INVERTER_QPIWS
+#include "inverter_warnings.h"
+#endif
+#include "poll_profile_select.h"
 #include "esphome/components/select/select.h"
 
 
-#include <queue>
+#include <deque>
 #include <vector>
 #include <string>
 
@@ -29,11 +38,103 @@ struct CommandEntry {
   std::string command;
   uint32_t interval_ms;   // интервал в миллисекундах
   uint32_t last_run_ms;   // время последнего запуска (millis())
+  uint32_t next_due_ms{0};  // крайний срок следующего запуска
+  bool enabled{true};
+
+  // Адаптивный опрос: interval_ms растягивается от min_interval_ms
+  uint32_t min_interval_ms{0};
+  uint32_t payload_hash{0};
+  uint8_t stable_polls{0};    // подряд одинаковых ответов
+
+  // Статистика планировщика
+  float period_ms{0};        // фактический период (EWMA)
+  float jitter_ms{0};        // |период - интервал| (EWMA)
+  uint32_t missed_count{0};  // запуск опоздал на целый интервал и больше
+
+  sensor::Sensor *period_sensor{nullptr};
+  sensor::Sensor *jitter_sensor{nullptr};
+  sensor::Sensor *missed_sensor{nullptr};
 };
 
-struct PendingResult {
+// Итог транзакции на шине команд
+enum CommandResult : uint8_t {
+  COMMAND_RESPONSE,     // ответ с данными
+  COMMAND_ACK,
+  COMMAND_NAK,
+  COMMAND_TIMEOUT,
+  COMMAND_CRC_ERROR,
+  COMMAND_SUPERSEDED,   // заменена более новой записью того же параметра
+  COMMAND_DROPPED,      // очередь переполнена или нет связи
+  COMMAND_UNEXPECTED,   // ответ не того вида: данные на запись или ACK/NAK на запрос
+};
+const char *command_result_to_string(CommandResult result);
+
+// Состояние связи с инвертором
+enum LinkState : uint8_t {
+  LINK_ONLINE,
+  LINK_DEGRADED,   // несколько таймаутов подряд, опрос продолжается
+  LINK_OFFLINE,    // опрос остановлен, только пробный запрос с растущей паузой
+};
+const char *link_state_to_string(LinkState state);
+
+// payload действителен только на время вызова
+using CommandCallback = std::function<void(CommandResult result, std::string_view payload)>;
+
+// Команда вне расписания; записи с одинаковым key сливаются в очереди
+struct PriorityCommand {
+  std::string key;       // целевой параметр (для запросов — сама команда)
   std::string command;
-  std::string payload;
+  CommandCallback callback;
+};
+
+// Строка таблицы опроса (из YAML) или переопределение в профиле
+struct PollSetting {
+  std::string command;
+  uint32_t interval_ms;
+  bool enabled;
+};
+
+// Именованный профиль опроса; interval_ms != 0 задаёт интервал всем командам
+struct PollProfile {
+  std::string name;
+  uint32_t interval_ms;
+  uint32_t duration_ms;   // 0 — без возврата к таблице по умолчанию
+  std::vector<PollSetting> overrides;
+};
+
+struct PollDiagnostics {
+  std::string command;
+  sensor::Sensor *period;
+  sensor::Sensor *jitter;
+  sensor::Sensor *missed;
+  sensor::Sensor *response_time;
+  sensor::Sensor *response_timeout;
+};
+
+// Политика публикации числового поля (YAML publish_policies)
+struct PublishPolicy {
+  EntitySlot slot;
+  float deadband;            // абсолютная; 0 — публиковать при любом изменении
+  float deadband_percent;    // доля от последнего опубликованного значения
+  uint32_t min_interval_ms;  // не чаще
+  uint32_t heartbeat_ms;     // не реже (0 — только по изменению)
+  float last_value{NAN};
+  uint32_t last_publish_ms{0};
+};
+
+// Время ответа на команду (ключ — command_key_()); по нему считается таймаут
+struct ResponseTimeStats {
+  static constexpr size_t WINDOW = 16;
+  float ewma_ms{0};
+  float dev_ms{0};              // сглаженное отклонение (как RTTVAR в TCP)
+  uint16_t window[WINDOW]{};    // последние замеры для перцентилей
+  uint8_t count{0};
+  uint8_t next{0};
+  uint16_t p50_ms{0};
+  uint16_t p90_ms{0};
+  uint16_t reply_bytes{0};      // самый длинный ответ, байт
+  uint8_t timeouts{0};          // подряд; каждый удваивает таймаут
+  uint32_t timeout_ms{0};       // последний выданный таймаут
 };
 
 struct Date {
@@ -42,12 +143,16 @@ struct Date {
   int year;
 };
 
-struct EnergyValue {
-  float value;
-  uint8_t day;
-  uint8_t month;
-  uint16_t year;
-};
+// ────────────────────────────────────────────────────────────────
+// QFLAG: флаги 'a'..'z' -> биты 0..25
+// ────────────────────────────────────────────────────────────────
+inline constexpr uint8_t QFLAG_FLAG_COUNT = 26;
+inline constexpr uint32_t QFLAG_ALL_MASK = (uint32_t(1) << QFLAG_FLAG_COUNT) - 1;
+constexpr uint32_t qflag_bit(char flag) { return uint32_t(1) << (flag - 'a'); }
+// Флаги, описанные в протоколе (a b d g k m u v w x y z)
+inline constexpr uint32_t QFLAG_KNOWN_MASK = qflag_bit('a') | qflag_bit('b') | qflag_bit('d') | qflag_bit('g') |
+                                             qflag_bit('k') | qflag_bit('m') | qflag_bit('u') | qflag_bit('v') |
+                                             qflag_bit('w') | qflag_bit('x') | qflag_bit('y') | qflag_bit('z');
 
 class SolarInverter : public uart::UARTDevice, public Component {
  public:
@@ -59,10 +164,13 @@ class SolarInverter : public uart::UARTDevice, public Component {
    void set_protocol_id_sensor(text_sensor::TextSensor *sens) { protocol_id_sensor_ = sens; }
    void set_serial_number_sensor(text_sensor::TextSensor *sens) { serial_number_sensor_ = sens; }
  
+#ifdef USE_SOLAR_INVERTER_QMOD
    // Сеттеры для QMOD
    void set_device_mode_sensor(text_sensor::TextSensor *sens) { device_mode_sensor_ = sens; }
    void set_device_mode_text(text_sensor::TextSensor *sens) { device_mode_text_ = sens; }
+#endif
 
+#ifdef USE_SOLAR_INVERTER_QFLAG
   // Сеттеры для QFLAG бинарных сенсоров
   void set_buzzer_control(InverterSwitch *sw) { buzzer_control_ = sw; }
   void set_overload_bypass(InverterSwitch *sw) { overload_bypass_ = sw; }
@@ -76,31 +184,51 @@ class SolarInverter : public uart::UARTDevice, public Component {
   void set_data_log_popup(InverterSwitch *sw) { data_log_popup_ = sw; }
   void set_grid_charge_enable(InverterSwitch *sw) { grid_charge_enable_ = sw; }
   void set_solar_feed_to_grid(InverterSwitch *sw) { solar_feed_to_grid_ = sw; }
+  void set_qflag_unknown_flags_sensor(text_sensor::TextSensor *sens) { qflag_unknown_flags_sensor_ = sens; }
+  // Бит i — флаг 'a' + i; 0 в get_qflag_mask() — флаг выключен или не сообщён
+  uint32_t get_qflag_mask() const { return this->qflag_enabled_mask_; }
+  uint32_t get_qflag_unknown_mask() const { return this->qflag_unknown_mask_; }
+#endif
+#ifdef USE_SOLAR_INVERTER_QPIWS
   // QPIWS
   void set_warning_status_text_sensor(text_sensor::TextSensor *sensor) { this->warning_status_text_sensor_ = sensor; }
+  void set_warning_binary_sensor(uint8_t bit, binary_sensor::BinarySensor *sensor) {
+    size_t row = warning_row(bit);
+    if (row < WARNING_COUNT)
+      this->warning_binary_sensors_[row] = sensor;
+  }
+  // Текущая маска QPIWS (бит i — символ i ответа) и история предупреждения
+  uint64_t get_warning_mask() const { return this->warning_mask_; }
+  const WarningStats *get_warning_stats(uint8_t bit) const {
+    size_t row = warning_row(bit);
+    return row < WARNING_COUNT ? &this->warning_stats_[row] : nullptr;
+  }
+#endif
+  void set_link_state_text_sensor(text_sensor::TextSensor *sensor) { this->link_state_text_sensor_ = sensor; }
+  void set_link_state_duration_sensor(sensor::Sensor *sensor) { this->link_state_duration_sensor_ = sensor; }
 
    // Сеттеры для QPIGS сенсоров (числовые)
-   void set_grid_voltage_sensor(sensor::Sensor *sens) { grid_voltage_sensor_ = sens; }
-   void set_grid_freq_sensor(sensor::Sensor *sens) { grid_freq_sensor_ = sens; }
-   void set_ac_output_voltage_sensor(sensor::Sensor *sens) { ac_output_voltage_sensor_ = sens; }
-   void set_ac_output_freq_sensor(sensor::Sensor *sens) { ac_output_freq_sensor_ = sens; }
-   void set_output_apparent_power_sensor(sensor::Sensor *sens) { output_apparent_power_sensor_ = sens; }
-   void set_output_active_power_sensor(sensor::Sensor *sens) { output_active_power_sensor_ = sens; }
-   void set_output_load_percent_sensor(sensor::Sensor *sens) { output_load_percent_sensor_ = sens; }
-   void set_bus_voltage_sensor(sensor::Sensor *sens) { bus_voltage_sensor_ = sens; }
-   void set_battery_voltage_sensor(sensor::Sensor *sens) { battery_voltage_sensor_ = sens; }
-   void set_battery_charging_current_sensor(sensor::Sensor *sens) { battery_charging_current_sensor_ = sens; }
-   void set_battery_capacity_sensor(sensor::Sensor *sens) { battery_capacity_sensor_ = sens; }
-   void set_inverter_temp_sensor(sensor::Sensor *sens) { inverter_temp_sensor_ = sens; }
-   void set_pv_input_current_sensor(sensor::Sensor *sens) { pv_input_current_sensor_ = sens; }
-   void set_pv_input_voltage_sensor(sensor::Sensor *sens) { pv_input_voltage_sensor_ = sens; }
-   void set_battery_voltage_from_scc_sensor(sensor::Sensor *sens) { battery_voltage_from_scc_sensor_ = sens; }
-   void set_battery_discharge_current_sensor(sensor::Sensor *sens) { battery_discharge_current_sensor_ = sens; }
-   void set_pv_charging_power_sensor(sensor::Sensor *sens) { pv_charging_power_sensor_ = sens; }
-   void set_fan_on_voltage_offset_sensor(sensor::Sensor *sens) { fan_on_voltage_offset_sensor_ = sens; }
+   void set_grid_voltage_sensor(sensor::Sensor *sens) { field_entities_[SLOT_GRID_VOLTAGE] = sens; }
+   void set_grid_freq_sensor(sensor::Sensor *sens) { field_entities_[SLOT_GRID_FREQ] = sens; }
+   void set_ac_output_voltage_sensor(sensor::Sensor *sens) { field_entities_[SLOT_AC_OUTPUT_VOLTAGE] = sens; }
+   void set_ac_output_freq_sensor(sensor::Sensor *sens) { field_entities_[SLOT_AC_OUTPUT_FREQ] = sens; }
+   void set_output_apparent_power_sensor(sensor::Sensor *sens) { field_entities_[SLOT_OUTPUT_APPARENT_POWER] = sens; }
+   void set_output_active_power_sensor(sensor::Sensor *sens) { field_entities_[SLOT_OUTPUT_ACTIVE_POWER] = sens; }
+   void set_output_load_percent_sensor(sensor::Sensor *sens) { field_entities_[SLOT_OUTPUT_LOAD_PERCENT] = sens; }
+   void set_bus_voltage_sensor(sensor::Sensor *sens) { field_entities_[SLOT_BUS_VOLTAGE] = sens; }
+   void set_battery_voltage_sensor(sensor::Sensor *sens) { field_entities_[SLOT_BATTERY_VOLTAGE] = sens; }
+   void set_battery_charging_current_sensor(sensor::Sensor *sens) { field_entities_[SLOT_BATTERY_CHARGING_CURRENT] = sens; }
+   void set_battery_capacity_sensor(sensor::Sensor *sens) { field_entities_[SLOT_BATTERY_CAPACITY] = sens; }
+   void set_inverter_temp_sensor(sensor::Sensor *sens) { field_entities_[SLOT_INVERTER_TEMP] = sens; }
+   void set_pv_input_current_sensor(sensor::Sensor *sens) { field_entities_[SLOT_PV_INPUT_CURRENT] = sens; }
+   void set_pv_input_voltage_sensor(sensor::Sensor *sens) { field_entities_[SLOT_PV_INPUT_VOLTAGE] = sens; }
+   void set_battery_voltage_from_scc_sensor(sensor::Sensor *sens) { field_entities_[SLOT_BATTERY_VOLTAGE_FROM_SCC] = sens; }
+   void set_battery_discharge_current_sensor(sensor::Sensor *sens) { field_entities_[SLOT_BATTERY_DISCHARGE_CURRENT] = sens; }
+   void set_pv_charging_power_sensor(sensor::Sensor *sens) { field_entities_[SLOT_PV_CHARGING_POWER] = sens; }
+   void set_fan_on_voltage_offset_sensor(sensor::Sensor *sens) { field_entities_[SLOT_FAN_ON_VOLTAGE_OFFSET] = sens; }
  
    // EEPROM версия (text)
-   void set_eeprom_version_text(text_sensor::TextSensor *sens) { eeprom_version_text_ = sens; }
+   void set_eeprom_version_text(text_sensor::TextSensor *sens) { field_entities_[SLOT_EEPROM_VERSION] = sens; }
  
    // Бинарные сенсоры b7..b0
    void set_pv_or_ac_powering_load(binary_sensor::BinarySensor *sens) { pv_or_ac_powering_load_ = sens; }
@@ -121,37 +249,51 @@ class SolarInverter : public uart::UARTDevice, public Component {
    void set_inverter_on(binary_sensor::BinarySensor *sens) { inverter_on_ = sens; }
    void set_dustproof_installed(binary_sensor::BinarySensor *sens) { dustproof_installed_ = sens; }
  
-   // История генерации энергии
-   void set_energy_solar_today_sensor(sensor::Sensor *sens) { energy_solar_today_sensor_ = sens; }
-   void set_energy_solar_month_sensor(sensor::Sensor *sens) { energy_solar_month_sensor_ = sens; }
-   void set_energy_solar_year_sensor(sensor::Sensor *sens) { energy_solar_year_sensor_ = sens; }
-   void set_energy_solar_total_sensor(sensor::Sensor *sens) { energy_solar_total_sensor_ = sens; }
- 
-   void set_energy_inverter_today_sensor(sensor::Sensor *sens) { energy_inverter_today_sensor_ = sens; }
-   void set_energy_inverter_month_sensor(sensor::Sensor *sens) { energy_inverter_month_sensor_ = sens; }
-   void set_energy_inverter_year_sensor(sensor::Sensor *sens) { energy_inverter_year_sensor_ = sens; }
-   void set_energy_inverter_total_sensor(sensor::Sensor *sens) { energy_inverter_total_sensor_ = sens; }
+   // Счётчики энергии: поток из ENERGY_FLOWS и период
+   void set_energy_sensor(EnergyFlow flow, EnergyPeriod period, sensor::Sensor *sens) {
+     energy_[flow].sensors[period] = sens;
+   }
+   const EnergyCounter &get_energy_counter(EnergyFlow flow) const { return energy_[flow].counter; }
+   // Запись счётчиков: после прироста total на delta или раз в interval
+   void set_energy_save_delta(float wh) { energy_save_delta_mwh_ = static_cast<uint32_t>(wh * 1000.0f); }
+   void set_energy_save_interval(uint32_t ms) { energy_save_interval_ms_ = ms; }
+#ifdef USE_SOLAR_INVERTER_HISTORY
+   // Почасовая история за days суток, выгрузка через web_server
+   void set_energy_history(uint8_t days, web_server_base::WebServerBase *base) {
+     energy_history_.set_days(days);
+     energy_history_base_ = base;
+   }
+   EnergyHistory &get_energy_history() { return this->energy_history_; }
+#endif
+   // Интервал между кадрами QPIGS длиннее этого не интегрируется
+   void set_energy_max_gap(uint32_t ms) {
+     for (auto &acc : energy_)
+       acc.integrator.set_max_gap(ms);
+   }
 
   // Сеттеры для QBEQI 
-  void set_equalization_enable(InverterSelect *s) { equalization_enable_ = s; }
-  void set_equalization_voltage(InverterNumber *s) { equalization_voltage_ = s; }
-  void set_equalization_over_time(InverterNumber *s) { equalization_over_time_ = s; }
-  void set_equalization_time(InverterNumber *s) { equalization_time_ = s; }
-  void set_equalization_period(InverterNumber *s) { equalization_period_ = s; }
+  void set_equalization_enable(InverterSelect *s) { field_entities_[SLOT_EQUALIZATION_ENABLE] = s; }
+  void set_equalization_voltage(InverterNumber *s) { field_entities_[SLOT_EQUALIZATION_VOLTAGE] = s; }
+  void set_equalization_over_time(InverterNumber *s) { field_entities_[SLOT_EQUALIZATION_OVER_TIME] = s; }
+  void set_equalization_time(InverterNumber *s) { field_entities_[SLOT_EQUALIZATION_TIME] = s; }
+  void set_equalization_period(InverterNumber *s) { field_entities_[SLOT_EQUALIZATION_PERIOD] = s; }
 
-  void set_equalization_active(InverterSelect *s) { equalization_active_ = s; }
+  void set_equalization_active(InverterSelect *s) { field_entities_[SLOT_EQUALIZATION_ACTIVE] = s; }
 
-  void set_equalization_max_current(sensor::Sensor *s) { equalization_max_current_ = s; }
-  void set_equalization_elapsed_time(sensor::Sensor *s) { equalization_elapsed_time_ = s; }
+  void set_equalization_max_current(sensor::Sensor *s) { field_entities_[SLOT_EQUALIZATION_MAX_CURRENT] = s; }
+  void set_equalization_elapsed_time(sensor::Sensor *s) { field_entities_[SLOT_EQUALIZATION_ELAPSED_TIME] = s; }
 
   // ────────────────────────────────────────────────────────────
   // ── Сенсоры конфигурации (QPI, QID, QMOD, …)               ──
   // ────────────────────────────────────────────────────────────
   text_sensor::TextSensor *protocol_id_sensor_{nullptr};
   text_sensor::TextSensor *serial_number_sensor_{nullptr};
+#ifdef USE_SOLAR_INVERTER_QMOD
   text_sensor::TextSensor *device_mode_sensor_{nullptr};
   text_sensor::TextSensor *device_mode_text_{nullptr};
+#endif
 
+#ifdef USE_SOLAR_INVERTER_QFLAG
   // ────────────────────────────────────────────────────────────
   // ── Сенсоры конфигурации (QFLAG)               ──
   // ────────────────────────────────────────────────────────────
@@ -167,116 +309,61 @@ class SolarInverter : public uart::UARTDevice, public Component {
   InverterSwitch *data_log_popup_{nullptr};
   InverterSwitch *solar_feed_to_grid_{nullptr};
   InverterSwitch *grid_charge_enable_{nullptr};
+#endif
 
   // ────────────────────────────────────────────────────────────
-  // ── Сенсоры QPIGS (числовые)                               ──
+  // ── Сущности полей QPIGS / QBEQI / QPIRI                   ──
+  // ── (тип и назначение — в таблицах inverter_decoder.h)     ──
   // ────────────────────────────────────────────────────────────
-  sensor::Sensor *grid_voltage_sensor_{nullptr};            // 0
-  sensor::Sensor *grid_freq_sensor_{nullptr};               // 1
-  sensor::Sensor *ac_output_voltage_sensor_{nullptr};       // 2
-  sensor::Sensor *ac_output_freq_sensor_{nullptr};          // 3
-  sensor::Sensor *output_apparent_power_sensor_{nullptr};   // 4
-  sensor::Sensor *output_active_power_sensor_{nullptr};     // 5
-  sensor::Sensor *output_load_percent_sensor_{nullptr};     // 6
-  sensor::Sensor *bus_voltage_sensor_{nullptr};             // 7
-  sensor::Sensor *battery_voltage_sensor_{nullptr};         // 8
-  sensor::Sensor *battery_charging_current_sensor_{nullptr};// 9
-  sensor::Sensor *battery_capacity_sensor_{nullptr};        // 10
-  sensor::Sensor *inverter_temp_sensor_{nullptr};           // 11
-  sensor::Sensor *pv_input_current_sensor_{nullptr};        // 12
-  sensor::Sensor *pv_input_voltage_sensor_{nullptr};        // 13
-  sensor::Sensor *battery_voltage_from_scc_sensor_{nullptr};// 14
-  sensor::Sensor *battery_discharge_current_sensor_{nullptr};// 15
-  sensor::Sensor *pv_charging_power_sensor_{nullptr};       // 19
-  sensor::Sensor *fan_on_voltage_offset_sensor_{nullptr};   // 17 (QQ *0.01)
+  EntityBase *field_entities_[SLOT_COUNT]{};
 
+#ifdef USE_SOLAR_INVERTER_QPIWS
   // QPIWS
   text_sensor::TextSensor *warning_status_text_sensor_{nullptr};
-  
-  // QBEQI параметры
-  InverterSelect *equalization_enable_{nullptr};        // B: 0/1
-  InverterNumber *equalization_time_{nullptr};          // CCC: минуты
-  InverterNumber *equalization_period_{nullptr};        // DDD: дни
-  sensor::Sensor *equalization_max_current_{nullptr};   // EEE: A
-  InverterNumber *equalization_voltage_{nullptr};       // GG.GG: V
-  InverterNumber *equalization_over_time_{nullptr};     // III: минуты
-  InverterSelect *equalization_active_{nullptr};        // J: 0/1
-  sensor::Sensor *equalization_elapsed_time_{nullptr};  // KKKK: часы
-
-  // QPIRI параметры
-  std::vector<std::string> qpiri_parts_;
-
-  sensor::Sensor *grid_rating_voltage_{nullptr};            // BBB.B  V
-  sensor::Sensor *grid_rating_current_{nullptr};            // CC.C   A
-  InverterNumber *ac_output_rating_voltage_{nullptr};       // DDD.D  V
-  InverterNumber *ac_output_rating_frequency_{nullptr};     // EE.E   Hz
-  InverterNumber *ac_output_rating_current_{nullptr};       // FF.F   A
-  InverterNumber *ac_output_apparent_power_{nullptr};       // HHHH   VA
-  InverterNumber *ac_output_active_power_{nullptr};         // IIII   W
-  InverterNumber *battery_rating_voltage_{nullptr};         // JJ.J   V
-  InverterNumber *battery_recharge_voltage_{nullptr};       // KK.K   V
-  InverterNumber *battery_undervoltage_{nullptr};           // JJ.J   V
-  InverterNumber *battery_bulk_voltage_{nullptr};           // KK.K   V
-  InverterNumber *battery_float_voltage_{nullptr};          // LL.L   V
-  InverterSelect *battery_type_{nullptr};                   // O      enum
-  InverterNumber *max_ac_charging_current_{nullptr};        // PPP    A
-  InverterNumber *max_charging_current_{nullptr};           // QQ0    A
-  InverterSelect *input_voltage_range_{nullptr};            // O      enum
-  InverterSelect *output_source_priority_{nullptr};         // P      enum
-  InverterSelect *charger_source_priority_{nullptr};        // Q      enum
-  sensor::Sensor *parallel_max_number_{nullptr};            // R      count
-  InverterSelect *machine_type_{nullptr};                   // SS     enum
-  InverterSelect *topology_{nullptr};                       // T      enum
-  InverterSelect *output_mode_{nullptr};                    // U      enum
-  InverterNumber *battery_redischarge_voltage_{nullptr};    // VV.V   V
-  InverterSelect *pv_ok_condition_{nullptr};                // W      enum
-  InverterSelect *pv_power_balance_{nullptr};               // X      enum
-  sensor::Sensor *neizvestno_{nullptr};                     // X.XX   ?
-  InverterNumber *grid_tie_current_{nullptr};               // YY     A
-  InverterNumber *operation_logic_{nullptr};                // Zz.z   ?
+  binary_sensor::BinarySensor *warning_binary_sensors_[WARNING_COUNT]{};
+  WarningStats warning_stats_[WARNING_COUNT]{};
+  uint64_t warning_mask_{0};
+  bool warning_mask_valid_{false};
+#endif
+  text_sensor::TextSensor *link_state_text_sensor_{nullptr};
+  sensor::Sensor *link_state_duration_sensor_{nullptr};
+
 
   // Сеттеры для QPIRI
   // sensor::Sensor (read-only)
-  void set_grid_rating_voltage(sensor::Sensor *s) { grid_rating_voltage_ = s; }
-  void set_grid_rating_current(sensor::Sensor *s) { grid_rating_current_ = s; }
-  void set_parallel_max_number(sensor::Sensor *s) { parallel_max_number_ = s; }
-  void set_neizvestno(sensor::Sensor *s) { neizvestno_ = s; }
+  void set_grid_rating_voltage(sensor::Sensor *s) { field_entities_[SLOT_GRID_RATING_VOLTAGE] = s; }
+  void set_grid_rating_current(sensor::Sensor *s) { field_entities_[SLOT_GRID_RATING_CURRENT] = s; }
+  void set_parallel_max_number(sensor::Sensor *s) { field_entities_[SLOT_PARALLEL_MAX_NUMBER] = s; }
+  void set_neizvestno(sensor::Sensor *s) { field_entities_[SLOT_NEIZVESTNO] = s; }
 
   // InverterNumber (writable)
-  void set_battery_rating_voltage(InverterNumber *s) { battery_rating_voltage_ = s; }
-  void set_ac_output_rating_voltage(InverterNumber *s) { ac_output_rating_voltage_ = s; }
-  void set_ac_output_rating_frequency(InverterNumber *s) { ac_output_rating_frequency_ = s; }
-  void set_ac_output_rating_current(InverterNumber *s) { ac_output_rating_current_ = s; }
-  void set_ac_output_apparent_power(InverterNumber *s) { ac_output_apparent_power_ = s; }
-  void set_ac_output_active_power(InverterNumber *s) { ac_output_active_power_ = s; }
-  void set_battery_recharge_voltage(InverterNumber *s) { battery_recharge_voltage_ = s; }
-  void set_battery_undervoltage(InverterNumber *s) { battery_undervoltage_ = s; }
-  void set_battery_bulk_voltage(InverterNumber *s) { battery_bulk_voltage_ = s; }
-  void set_battery_float_voltage(InverterNumber *s) { battery_float_voltage_ = s; }
-  void set_max_ac_charging_current(InverterNumber *s) { max_ac_charging_current_ = s; }
-  void set_max_charging_current(InverterNumber *s) { max_charging_current_ = s; }
-  void set_battery_redischarge_voltage(InverterNumber *s) { battery_redischarge_voltage_ = s; }
-  void set_grid_tie_current(InverterNumber *s) { grid_tie_current_ = s; }
-  void set_operation_logic(InverterNumber *s) { operation_logic_ = s; }
+  void set_battery_rating_voltage(InverterNumber *s) { field_entities_[SLOT_BATTERY_RATING_VOLTAGE] = s; }
+  void set_ac_output_rating_voltage(InverterNumber *s) { field_entities_[SLOT_AC_OUTPUT_RATING_VOLTAGE] = s; }
+  void set_ac_output_rating_frequency(InverterNumber *s) { field_entities_[SLOT_AC_OUTPUT_RATING_FREQUENCY] = s; }
+  void set_ac_output_rating_current(InverterNumber *s) { field_entities_[SLOT_AC_OUTPUT_RATING_CURRENT] = s; }
+  void set_ac_output_apparent_power(InverterNumber *s) { field_entities_[SLOT_AC_OUTPUT_APPARENT_POWER] = s; }
+  void set_ac_output_active_power(InverterNumber *s) { field_entities_[SLOT_AC_OUTPUT_ACTIVE_POWER] = s; }
+  void set_battery_recharge_voltage(InverterNumber *s) { field_entities_[SLOT_BATTERY_RECHARGE_VOLTAGE] = s; }
+  void set_battery_undervoltage(InverterNumber *s) { field_entities_[SLOT_BATTERY_UNDERVOLTAGE] = s; }
+  void set_battery_bulk_voltage(InverterNumber *s) { field_entities_[SLOT_BATTERY_BULK_VOLTAGE] = s; }
+  void set_battery_float_voltage(InverterNumber *s) { field_entities_[SLOT_BATTERY_FLOAT_VOLTAGE] = s; }
+  void set_max_ac_charging_current(InverterNumber *s) { field_entities_[SLOT_MAX_AC_CHARGING_CURRENT] = s; }
+  void set_max_charging_current(InverterNumber *s) { field_entities_[SLOT_MAX_CHARGING_CURRENT] = s; }
+  void set_battery_redischarge_voltage(InverterNumber *s) { field_entities_[SLOT_BATTERY_REDISCHARGE_VOLTAGE] = s; }
+  void set_grid_tie_current(InverterNumber *s) { field_entities_[SLOT_GRID_TIE_CURRENT] = s; }
+  void set_operation_logic(InverterNumber *s) { field_entities_[SLOT_OPERATION_LOGIC] = s; }
 
   // InverterSelect (writable enums)
-  void set_battery_type(InverterSelect *s) { battery_type_ = s; }
-  void set_input_voltage_range(InverterSelect *s) { input_voltage_range_ = s; }
-  void set_output_source_priority(InverterSelect *s) { output_source_priority_ = s; }
-  void set_charger_source_priority(InverterSelect *s) { charger_source_priority_ = s; }
-  void set_machine_type(InverterSelect *s) { machine_type_ = s; }
-  void set_topology(InverterSelect *s) { topology_ = s; }
-  void set_output_mode(InverterSelect *s) { output_mode_ = s; }
-  void set_pv_ok_condition(InverterSelect *s) { pv_ok_condition_ = s; }
-  void set_pv_power_balance(InverterSelect *s) { pv_power_balance_ = s; }
-
-  void publish_sensor(sensor::Sensor *sensor, int index);
-  void publish_number(InverterNumber *number, int index);
-  void publish_select(InverterSelect *sel, int index);
- 
+  void set_battery_type(InverterSelect *s) { field_entities_[SLOT_BATTERY_TYPE] = s; }
+  void set_input_voltage_range(InverterSelect *s) { field_entities_[SLOT_INPUT_VOLTAGE_RANGE] = s; }
+  void set_output_source_priority(InverterSelect *s) { field_entities_[SLOT_OUTPUT_SOURCE_PRIORITY] = s; }
+  void set_charger_source_priority(InverterSelect *s) { field_entities_[SLOT_CHARGER_SOURCE_PRIORITY] = s; }
+  void set_machine_type(InverterSelect *s) { field_entities_[SLOT_MACHINE_TYPE] = s; }
+  void set_topology(InverterSelect *s) { field_entities_[SLOT_TOPOLOGY] = s; }
+  void set_output_mode(InverterSelect *s) { field_entities_[SLOT_OUTPUT_MODE] = s; }
+  void set_pv_ok_condition(InverterSelect *s) { field_entities_[SLOT_PV_OK_CONDITION] = s; }
+  void set_pv_power_balance(InverterSelect *s) { field_entities_[SLOT_PV_POWER_BALANCE] = s; }
 
-  // EEPROM version (text)
-  text_sensor::TextSensor *eeprom_version_text_{nullptr};    // 18
 
   // ────────────────────────────────────────────────────────────
   // ── Бинарные сенсоры b7..b0 (index 16)                     ──
@@ -301,28 +388,19 @@ class SolarInverter : public uart::UARTDevice, public Component {
   binary_sensor::BinarySensor *dustproof_installed_{nullptr};// b8
 
   // ────────────────────────────────────────────────────────────
-  // ── История генерации                                      ──
+  // ── Учёт энергии                                           ──
   // ────────────────────────────────────────────────────────────
-  sensor::Sensor *energy_solar_today_sensor_{nullptr};
-  sensor::Sensor *energy_solar_month_sensor_{nullptr};
-  sensor::Sensor *energy_solar_year_sensor_{nullptr};
-  sensor::Sensor *energy_solar_total_sensor_{nullptr};
-
-  sensor::Sensor *energy_inverter_today_sensor_{nullptr};
-  sensor::Sensor *energy_inverter_month_sensor_{nullptr};
-  sensor::Sensor *energy_inverter_year_sensor_{nullptr};
-  sensor::Sensor *energy_inverter_total_sensor_{nullptr};
-
-  /* ---------- энерго‑счётчики, которые хотим сохранять ---------- */
-  float accumulated_energy_solar_today_{0};
-  float accumulated_energy_solar_month_{0};
-  float accumulated_energy_solar_year_{0};
-  float accumulated_energy_solar_total_{0.0f};
-
-  float accumulated_energy_inverter_today_{0};
-  float accumulated_energy_inverter_month_{0};
-  float accumulated_energy_inverter_year_{0};
-  float accumulated_energy_inverter_total_{0.0f};
+  EnergyAccumulator energy_[ENERGY_FLOW_COUNT];   // по строкам ENERGY_FLOWS
+  uint32_t energy_sequence_{0};      // последний проинтегрированный кадр QPIGS
+  uint32_t last_energy_save_ms_{0};
+  uint64_t energy_saved_mwh_[ENERGY_FLOW_COUNT]{};  // total потоков на момент последней записи
+  uint32_t energy_save_delta_mwh_{ENERGY_SAVE_DELTA_MWH};
+  uint32_t energy_save_interval_ms_{ENERGY_SAVE_INTERVAL_MS};
+  EnergyJournal<EnergyRecord> energy_journal_;
+#ifdef USE_SOLAR_INVERTER_HISTORY
+  EnergyHistory energy_history_;
+  web_server_base::WebServerBase *energy_history_base_{nullptr};
+#endif
 
   int last_day_{-1};
   int last_month_{-1};
@@ -330,103 +408,233 @@ class SolarInverter : public uart::UARTDevice, public Component {
 
   Date get_current_date();        // если нужна дата — объявите структуру Date
 
-  /* ---------- объекты‑ключи в NVS ---------- */
-  ESPPreferenceObject pref_solar_total_;
-  ESPPreferenceObject pref_inverter_total_;
-  ESPPreferenceObject pref_solar_year_;
-  ESPPreferenceObject pref_inverter_year_;
-  ESPPreferenceObject pref_solar_month_;
-  ESPPreferenceObject pref_inverter_month_;
-  ESPPreferenceObject pref_solar_today_;
-  ESPPreferenceObject pref_inverter_today_;
-
-
   /* ---------- методы ---------- */
+  uint64_t energy_unsaved_mwh_(bool measured_only) const;
+  void mark_energy_saved_();
   void save_energy_to_eeprom_();
-  void load_energy_from_eeprom_();   // новый
+  void load_energy_from_eeprom_();
+  bool load_legacy_energy_();        // float-ключи 0x6000–0x6007 до журнала
 
   // ────────────────────────────────────────────────────────────
   // ── Жизненный цикл                                         ──
   // ────────────────────────────────────────────────────────────
   void setup() override;
   void loop() override;
+  void on_shutdown() override;
 
   // ────────────────────────────────────────────────────────────
   // ── API для внешних модулей                                ──
   // ────────────────────────────────────────────────────────────
-  void add_poll_command(const std::string &cmd, uint32_t interval_ms);
-  void send_priority_command(const std::string &cmd);
+  void add_poll_command(const std::string &cmd, uint32_t interval_ms, bool enabled = true);
+  // Профили опроса, переключаемые во время работы
+  void add_poll_profile(const std::string &name, uint32_t interval_ms, uint32_t duration_ms);
+  void add_poll_profile_override(const std::string &profile, const std::string &cmd, uint32_t interval_ms,
+                                 bool enabled);
+  void set_poll_profile_select(PollProfileSelect *sel) { poll_profile_select_ = sel; }
+  bool set_poll_profile(const std::string &name);
+  const std::string &get_poll_profile() const { return active_poll_profile_; }
+  void send_priority_command(const std::string &cmd) { submit_command(cmd, nullptr); }
+  // Единая шина: все писатели (select, number, switch, лямбды) ставят команду
+  // в очередь; на линии всегда не больше одного запроса, итог — в callback
+  void submit_command(const std::string &cmd, CommandCallback callback);
+  // Диагностика опроса: фактический период, джиттер, пропущенные сроки
+  void add_poll_diagnostics(const std::string &cmd, sensor::Sensor *period, sensor::Sensor *jitter,
+                            sensor::Sensor *missed, sensor::Sensor *response_time = nullptr,
+                            sensor::Sensor *response_timeout = nullptr) {
+    poll_diagnostics_.push_back({cmd, period, jitter, missed, response_time, response_timeout});
+  }
+  void set_poll_rate_sensor(sensor::Sensor *sens) { poll_rate_sensor_ = sens; }
+  // Отправлять следующую команду сразу из обработчика завершённого кадра
+  void set_pipelined(bool pipelined) { pipelined_ = pipelined; }
+  // Адаптивный опрос: интервал удваивается после stable_polls одинаковых
+  // ответов (до max_interval_ms) и сбрасывается к исходному при изменении
+  void set_adaptive_polling(uint8_t stable_polls, uint32_t max_interval_ms, float power_rate, float voltage_rate) {
+    adaptive_polling_ = true;
+    adaptive_stable_polls_ = stable_polls;
+    adaptive_max_interval_ms_ = max_interval_ms;
+    adaptive_power_rate_ = power_rate;
+    adaptive_voltage_rate_ = voltage_rate;
+  }
+  // QPIRI вне периодического опроса: при загрузке, по смене бита b6 QPIGS,
+  // после команд записи и по страховочному таймеру
+  void set_qpiri_event_driven(uint32_t safety_interval_ms) {
+    qpiri_event_driven_ = true;
+    qpiri_safety_interval_ms_ = safety_interval_ms;
+  }
+  void request_qpiri_refresh();
+  // Фильтр публикации поля: мёртвая зона, минимальный интервал, heartbeat
+  void add_publish_policy(EntitySlot slot, float deadband, float deadband_percent, uint32_t min_interval_ms,
+                          uint32_t heartbeat_ms) {
+    publish_policies_.push_back({slot, deadband, deadband_percent, min_interval_ms, heartbeat_ms});
+    publish_policy_index_[slot] = publish_policies_.size();
+  }
+  // Сколько микросекунд за один loop() можно тратить на публикацию полей
+  void set_publish_budget_us(uint32_t budget_us) { publish_budget_us_ = budget_us; }
+  // Запись параметра с подтверждением: ACK + совпадение при повторном чтении,
+  // иначе повтор с нарастающей паузой и откат сущности
+  void begin_write(InverterWritable *entity, const std::string &cmd);
   void update_energy_history_();
+
+  LinkState get_link_state() const { return link_state_; }
+
+  // Последний разобранный ответ QPIGS / QBEQI / QPIRI (sequence == 0 — ещё не было)
+  const ResponseSnapshot *get_snapshot(const std::string &command) const;
+  const ResponseSnapshot &get_qpigs_snapshot() const { return *get_snapshot("QPIGS"); }
+
+  // Измеренное время ответа; nullptr, если команда ещё не отправлялась
+  const ResponseTimeStats *get_response_time_stats(const std::string &cmd) const;
+
+  // Счётчики отброшенных кадров (переполнение / таймаут / ресинхронизация)
+  const FrameReceiver &get_frame_receiver() const { return this->rx_; }
  private:
   
   InverterSelect *select_;
 
-  // Словарь для QFLAG переключателей
-  std::map<char, InverterSwitch*> qflag_switches_;
-
-  // Отправка команды включения/выключения флага
-  void set_flag(char flag, bool enabled);
-  
-  // Обработчик изменения состояния переключателя
-  void on_flag_changed(char flag, bool enabled) { set_flag(flag, enabled); }
+#ifdef USE_SOLAR_INVERTER_QFLAG
+  // QFLAG: переключатели по флагу 'a'..'z' и маски последнего ответа
+  InverterSwitch *qflag_switches_[QFLAG_FLAG_COUNT]{};
+  uint32_t qflag_enabled_mask_{0};
+  uint32_t qflag_unknown_mask_{0};   // флаги, о которых мы ничего не знаем
+  bool qflag_mask_valid_{false};
+  text_sensor::TextSensor *qflag_unknown_flags_sensor_{nullptr};
+#endif
 
   // ───────────────────────── Internal state ──────────────────
   enum State { IDLE, WAITING_RESPONSE } state_{IDLE};
-  std::queue<std::string> priority_commands_;
+  std::deque<PriorityCommand> priority_commands_;
+  std::vector<PollSetting> poll_defaults_;   // таблица опроса из YAML (профиль "default")
+  std::vector<PollProfile> poll_profiles_;
+  std::string active_poll_profile_{POLL_PROFILE_DEFAULT};
+  PollProfileSelect *poll_profile_select_{nullptr};
   std::vector<CommandEntry> poll_commands_;
-  size_t poll_index_{0};
-  std::queue<PendingResult> pending_results_;
+  std::vector<uint8_t> poll_heap_;  // индексы poll_commands_, min-heap по next_due_ms
+  std::vector<PollDiagnostics> poll_diagnostics_;
+  sensor::Sensor *poll_rate_sensor_{nullptr};
+  uint32_t completed_polls_{0};   // завершённые транзакции с последней публикации
+  uint32_t poll_rate_since_ms_{0};
+  bool pipelined_{false};
+
+  // Адаптивный опрос
+  bool adaptive_polling_{false};
+  uint8_t adaptive_stable_polls_{5};
+  uint32_t adaptive_max_interval_ms_{60000};
+  float adaptive_power_rate_{50.0f};      // Вт/с
+  float adaptive_voltage_rate_{0.05f};    // В/с
+  float adaptive_last_power_{NAN};
+  float adaptive_last_voltage_{NAN};
+  uint32_t adaptive_last_sample_ms_{0};
+
+  // Событийный QPIRI
+  bool qpiri_event_driven_{false};
+  uint32_t qpiri_safety_interval_ms_{600000};
+  int8_t last_config_changed_{-1};   // b6 из QPIGS, -1 — ещё не получен
 
   std::string current_command_;
-  std::string rx_buffer_;
-  bool receiving_{false};
+  CommandCallback current_callback_;
+  FrameReceiver rx_;
   uint32_t last_send_{0};
+  uint32_t response_timeout_ms_{RESPONSE_TIMEOUT_MS};   // для команды на линии
+  std::map<std::string, ResponseTimeStats> response_times_;
+
+  // Состояние связи
+  LinkState link_state_{LINK_ONLINE};
+  uint32_t link_state_since_ms_{0};
+  uint8_t consecutive_timeouts_{0};
+  uint32_t probe_interval_ms_{0};
+  uint32_t last_probe_ms_{0};
   bool ready_{false};
   bool ack_received_{false};
 
 
-  //  ─── Ответы, ожидающие публикации ───
-  std::string last_qpigs_data_;
-  bool qpigs_ready_{false};
-  size_t qpigs_publish_index_{0};
-
-  // Для пошаговой публикации QBEQI
-  std::string last_qbeqi_data_;
-  bool qbeqi_ready_{false};
-  size_t qbeqi_publish_index_{0};
-
-  // Для пошаговой публикации QPIRI
-  std::string last_qpiri_data_;
-  bool qpiri_ready_{false};
-  size_t qpiri_publish_index_{0};
+  //  ─── Ответы, ожидающие публикации (поля уже разбиты приёмником) ───
+  struct DecodeSource {
+    ResponseSnapshot snapshot;
+    uint8_t next_field{0};
+    bool ready{false};
+  };
+  DecodeSource decode_sources_[RESPONSE_COUNT];
+  uint8_t publish_cursor_{0};   // источник, с которого начнётся следующий проход
+  std::vector<PublishPolicy> publish_policies_;
+  uint8_t publish_policy_index_[SLOT_COUNT]{};   // номер политики + 1; 0 — без фильтра
+  uint32_t publish_budget_us_{PUBLISH_BUDGET_US};
 
   //  ─── Таймауты ───
-  static constexpr uint32_t RESPONSE_TIMEOUT_MS = 3000;
+  static constexpr uint32_t RESPONSE_TIMEOUT_MS = 3000;        // потолок и таймаут до первых замеров
+  static constexpr uint32_t RESPONSE_TIMEOUT_FLOOR_MS = 150;
+  static constexpr uint32_t RESPONSE_TIMEOUT_MARGIN_MS = 50;   // шаг loop() + буфер UART
+  static constexpr uint8_t RESPONSE_TIME_MIN_SAMPLES = 4;
+  static constexpr float RESPONSE_TIME_ALPHA = 0.125f;
+  static constexpr float RESPONSE_TIME_BETA = 0.25f;
+  static constexpr uint32_t DEFAULT_BAUD_RATE = 2400;
+  static constexpr uint8_t LINK_DEGRADED_TIMEOUTS = 2;
+  static constexpr uint8_t LINK_OFFLINE_TIMEOUTS = 5;
+  static constexpr uint32_t LINK_PROBE_MIN_MS = 2000;
+  static constexpr uint32_t LINK_PROBE_MAX_MS = 60000;
+  static constexpr uint32_t LINK_STATS_INTERVAL_MS = 10000;
+  static constexpr const char *LINK_PROBE_COMMAND = "QPI";
+  static constexpr uint32_t RX_INTERBYTE_TIMEOUT_MS = 500;
+  static constexpr size_t RX_CHUNK_SIZE = 64;
+  static constexpr size_t MAX_PRIORITY_COMMANDS = 16;
+  static constexpr uint32_t POLL_STATS_INTERVAL_MS = 10000;
+  static constexpr const char *POLL_PROFILE_DEFAULT = "default";
+  static constexpr float POLL_STATS_ALPHA = 0.2f;
+  static constexpr uint32_t PUBLISH_BUDGET_US = 2000;
+  static constexpr uint32_t ENERGY_SAVE_DELTA_MWH = 100000;     // 100 Вт·ч
+  static constexpr uint32_t ENERGY_SAVE_INTERVAL_MS = 600000;   // 10 мин
+  static constexpr int ENERGY_MIN_VALID_YEAR = 2020;            // раньше — часы ещё не синхронизированы
+  static constexpr uint8_t WRITE_MAX_ATTEMPTS = 3;
+  static constexpr uint32_t WRITE_BACKOFF_MS = 1000;         // удваивается с каждой попыткой
+  static constexpr uint32_t WRITE_READBACK_TIMEOUT_MS = 15000;
 
   //  ─── Внутренние методы ───
   void next_command_();
+  void reset_poll_schedule_();
+  void apply_poll_profile_(const PollProfile *profile);
+  void rebuild_poll_heap_();
+  void attach_poll_diagnostics_();
+  bool poll_due_later_(uint8_t a, uint8_t b) const;
+  void update_poll_stats_(CommandEntry &cmd, uint32_t now);
+  void publish_poll_stats_();
+  void adapt_poll_interval_(const std::string &command, const InverterFrame &frame);
+  bool qpigs_changed_fast_(const InverterFrame &frame, uint32_t now);
+  static uint32_t payload_hash_(std::string_view payload);
+  static std::string command_key_(const std::string &cmd);
   void send_command(const std::string &cmd);
-  void process_raw_response(const std::string &response);
-  void process_result(const std::string &command, const std::string &payload);
+  uint32_t frame_time_ms_(size_t bytes) const;
+  uint32_t response_timeout_for_(const std::string &cmd);
+  void record_response_time_(const std::string &cmd, uint32_t rtt_ms, size_t reply_bytes);
+  void set_link_state_(LinkState state);
+  void link_frame_received_();
+  void link_timeout_();
+  void publish_link_state_duration_();
+  void process_raw_response(const InverterFrame &frame);
+  void finish_transaction_(CommandResult result, std::string_view payload);
+  void process_result(const std::string &command, const InverterFrame &frame);
+  friend class InverterWritable;
+  void send_write_attempt_(InverterWritable *entity);
+  void on_write_result_(InverterWritable *entity, uint32_t seq, CommandResult result);
+  void on_write_readback_(InverterWritable *entity, bool matches);
+  void write_failed_(InverterWritable *entity, const char *reason);
   
   //  Публикация частями
-  void publish_next_qpigs_chunk_();
-  void process_qpigs_status_bits_(const std::string &bits);
-  void process_qpigs_flag_bits_(const std::string &bits);
+  void publish_pending_fields_();
+  bool publish_next_field_(const ResponseDescriptor &response, DecodeSource &source);
+  void apply_field_(const FieldDescriptor &desc, const DecodedField &field);
+  bool should_publish_(EntitySlot slot, float value);
+  void process_qpigs_status_bits_(std::string_view bits);
+  void process_qpigs_flag_bits_(std::string_view bits);
+#ifdef USE_SOLAR_INVERTER_QMOD
   void process_qmod_(const std::string &payload);
-  void process_qflag_(const std::string &payload);
-  std::string decode_qpiws_(const std::string &bits);
-  void publish_next_qbeqi_chunk_();
-  void publish_next_qpiri_chunk_();
+#endif
+#ifdef USE_SOLAR_INVERTER_QFLAG
+  void process_qflag_(std::string_view payload);
   void setup_qflag_switches();
+#endif
+#ifdef USE_SOLAR_INVERTER_QPIWS
+  void process_qpiws_(std::string_view bits);
+  static std::string warning_text_(uint64_t mask);
+#endif
 
-  //  CRC / utils
-  static uint16_t calculate_crc(const std::string &cmd);
-  static uint16_t cal_crc_half(const uint8_t *data, size_t len);
-  bool check_crc(const std::string &response);
-
-  static std::vector<std::string> split_string(const std::string &s, char delimiter);
-  static bool safe_stof(const std::string &s, float &value);
  protected:
   std::map<int, InverterSelect*> inverter_selects_by_index_;
 };
@@ -0,0 +1,87 @@
+// Отправка команд опроса: старая CRC по полубайтам + четыре записи в UART
+// против готовых кадров COMMAND_FRAMES + одна запись (хост):
+//   g++ -std=c++17 -O2 -I../../components/solar_inverter bench_command_frame.cpp -o bench_command_frame && ./bench_command_frame
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "inverter_frame.h"
+
+using namespace esphome::solar_inverter;
+
+// Прежняя реализация: таблица на 16 элементов, два шага на байт
+static uint16_t nibble_crc_update(uint16_t crc, uint8_t byte) {
+  static const uint16_t TABLE[16] = {0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+                                     0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef};
+  uint8_t da = (crc >> 12) & 0x0F;
+  crc <<= 4;
+  crc ^= TABLE[da ^ (byte >> 4)];
+  da = (crc >> 12) & 0x0F;
+  crc <<= 4;
+  crc ^= TABLE[da ^ (byte & 0x0F)];
+  return crc;
+}
+
+static uint16_t nibble_crc(const std::string &cmd) {
+  uint16_t crc = 0;
+  for (char c : cmd)
+    crc = nibble_crc_update(crc, static_cast<uint8_t>(c));
+  return crc_escape(crc);
+}
+
+// Заглушки UART: не встраиваются, чтобы число вызовов оставалось в замере
+volatile uint32_t sink;
+__attribute__((noinline)) static void uart_write_array(const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    sink = sink + data[i];
+}
+__attribute__((noinline)) static void uart_write_byte(uint8_t byte) { sink = sink + byte; }
+
+static const std::string POLL_COMMANDS[] = {"QPIGS", "QPIWS", "QMOD", "QFLAG", "QPIRI", "QBEQI"};
+static const std::string WRITE_COMMANDS[] = {"PBEQV58.40", "MUCHGC030"};
+static constexpr int ROUNDS = 2000000;
+
+template<typename F> static void run(const char *name, F send) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; i++)
+    send(POLL_COMMANDS[i % 6]);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  printf("%-42s %6.1f ns/cmd\n", name, std::chrono::duration<double, std::nano>(elapsed).count() / ROUNDS);
+}
+
+int main() {
+  // Сначала — совпадение CRC старой и новой реализации
+  auto crc_matches = [](const std::string &cmd) {
+    if (nibble_crc(cmd) == command_crc(cmd))
+      return true;
+    printf("MISMATCH %s\n", cmd.c_str());
+    return false;
+  };
+  for (const auto &cmd : POLL_COMMANDS) {
+    if (!crc_matches(cmd))
+      return 1;
+  }
+  for (const auto &cmd : WRITE_COMMANDS) {
+    if (!crc_matches(cmd))
+      return 1;
+  }
+
+  run("poll commands, old nibble CRC + 4 writes", [](const std::string &cmd) {
+    uint16_t crc = nibble_crc(cmd);
+    uart_write_array(reinterpret_cast<const uint8_t *>(cmd.data()), cmd.size());
+    uart_write_byte(crc >> 8);
+    uart_write_byte(crc & 0xFF);
+    uart_write_byte('\r');
+  });
+  run("poll commands, precomputed frame + 1 write", [](const std::string &cmd) {
+    const CommandFrame *frame = find_command_frame(cmd);
+    CommandFrame built;
+    if (frame == nullptr) {
+      built = make_command_frame(cmd);
+      frame = &built;
+    }
+    uart_write_array(frame->bytes, frame->len);
+  });
+  run("CRC only, nibble table", [](const std::string &cmd) { sink = sink + nibble_crc(cmd); });
+  run("CRC only, byte table", [](const std::string &cmd) { sink = sink + command_crc(cmd); });
+  return 0;
+}
@@ -0,0 +1,46 @@
+// Разбор полей QPIGS: parse_fixed против strtof (хост, для сравнения порядков):
+//   g++ -std=c++17 -O2 -I../../components/solar_inverter bench_parse.cpp -o bench_parse && ./bench_parse
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include "inverter_frame.h"
+
+using namespace esphome::solar_inverter;
+
+// Типичные поля ответа QPIGS
+static const char *const FIELDS[] = {"232.0", "50.0",  "230.0", "49.9",  "0092",  "0071", "001", "409", "53.10",
+                                     "002",   "084",   "0036",  "0003",  "101.1", "53.15", "00000", "00", "00319"};
+static constexpr size_t FIELD_COUNT = std::size(FIELDS);
+static constexpr int ROUNDS = 2000000;
+
+volatile float sink;
+
+template<typename F> static double ns_per_field(F parse) {
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < ROUNDS; n++) {
+    for (const char *field : FIELDS)
+      sink = sink + parse(field);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / ROUNDS / FIELD_COUNT;
+}
+
+int main() {
+  // Сначала — что оба разбора дают одно и то же
+  for (const char *field : FIELDS) {
+    FixedPoint fp;
+    if (parse_fixed(field, fp) != PARSE_OK || fp.to_float() != strtof(field, nullptr)) {
+      printf("MISMATCH %s\n", field);
+      return 1;
+    }
+  }
+  double fixed = ns_per_field([](const char *field) {
+    FixedPoint fp;
+    return parse_fixed(field, fp) == PARSE_OK ? fp.to_float() : 0.0f;
+  });
+  double libc = ns_per_field([](const char *field) { return strtof(field, nullptr); });
+  printf("parse_fixed %6.1f ns/field\n", fixed);
+  printf("strtof      %6.1f ns/field  (x%.1f)\n", libc, libc / fixed);
+  return 0;
+}
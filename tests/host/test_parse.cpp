@@ -0,0 +1,73 @@
+// Проверка разбора числовых полей (inverter_frame.h) на хосте:
+//   g++ -std=c++17 -Wall -I../../components/solar_inverter test_parse.cpp -o test_parse && ./test_parse
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include "inverter_frame.h"
+
+using namespace esphome::solar_inverter;
+
+static int failures = 0;
+
+static void check_fixed(const char *text, ParseStatus status, float value) {
+  FixedPoint fp{};
+  ParseStatus got = parse_fixed(text, fp);
+  if (got != status || (got == PARSE_OK && std::fabs(fp.to_float() - value) > 1e-4f)) {
+    printf("FAIL parse_fixed(\"%s\"): status %u, value %g\n", text, got, got == PARSE_OK ? fp.to_float() : 0.0f);
+    failures++;
+  }
+}
+
+static void check_scaled(const char *text, uint8_t decimals, ParseStatus status, int32_t value) {
+  int32_t out = 0;
+  ParseStatus got = parse_scaled(text, decimals, out);
+  if (got != status || (got == PARSE_OK && out != value)) {
+    printf("FAIL parse_scaled(\"%s\", %u): status %u, value %" PRId32 "\n", text, decimals, got, out);
+    failures++;
+  }
+}
+
+int main() {
+  // Форматы полей QPIGS / QPIRI
+  check_fixed("232.0", PARSE_OK, 232.0f);
+  check_fixed("053.10", PARSE_OK, 53.1f);
+  check_fixed("00036", PARSE_OK, 36);
+  check_fixed("-12.5", PARSE_OK, -12.5f);
+  check_fixed(".5", PARSE_OK, 0.5f);
+  check_fixed("5.", PARSE_OK, 5);
+  check_fixed("0000000000001", PARSE_OK, 1);
+  // Ошибки
+  check_fixed("", PARSE_EMPTY, 0);
+  check_fixed(".", PARSE_INVALID, 0);
+  check_fixed("-", PARSE_INVALID, 0);
+  check_fixed("1.2.3", PARSE_INVALID, 0);
+  check_fixed("12a", PARSE_INVALID, 0);
+  check_fixed("1234567890", PARSE_OVERFLOW, 0);
+
+  // Масштабирование вверх
+  check_scaled("53.1", 2, PARSE_OK, 5310);
+  check_scaled("-7", 3, PARSE_OK, -7000);
+  check_scaled("0", 255, PARSE_OK, 0);
+  check_scaled("21474836", 2, PARSE_OK, 2147483600);
+  check_scaled("21474837", 2, PARSE_OVERFLOW, 0);
+  check_scaled("-21474836", 2, PARSE_OK, -2147483600);
+  check_scaled("1", 255, PARSE_OVERFLOW, 0);
+  check_scaled("-999999999", 255, PARSE_OVERFLOW, 0);
+  // Округление одним делением, половина — от нуля
+  check_scaled("0.125", 2, PARSE_OK, 13);
+  check_scaled("-0.125", 2, PARSE_OK, -13);
+  check_scaled("0.149", 1, PARSE_OK, 1);
+  check_scaled("-0.149", 1, PARSE_OK, -1);
+  check_scaled("0.145", 2, PARSE_OK, 15);
+  check_scaled("0.1449", 2, PARSE_OK, 14);
+  check_scaled("0.15", 1, PARSE_OK, 2);
+  check_scaled("0.45", 0, PARSE_OK, 0);
+  check_scaled("0.5", 0, PARSE_OK, 1);
+  check_scaled("-0.5", 0, PARSE_OK, -1);
+  check_scaled("0.000000001", 0, PARSE_OK, 0);
+  check_scaled("999999.999", 0, PARSE_OK, 1000000);
+
+  if (failures == 0)
+    printf("OK\n");
+  return failures == 0 ? 0 : 1;
+}